@@ -0,0 +1,482 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// How arenas obtain their blocks from the system.
+struct ArenaOptions
+{
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    enum class HugePages
+    {
+        None,
+        // 2 MB aligned blocks advised with MADV_HUGEPAGE, the kernel backs
+        // them with transparent huge pages when it can
+        Transparent,
+        // MAP_HUGETLB blocks from the pool the administrator reserved in
+        // /proc/sys/vm/nr_hugepages, allocation fails when it is empty
+        Explicit
+    };
+
+    enum class Prefault
+    {
+        None,
+        // every page of a block is faulted in before it is used
+        Inline,
+        // Inline, and Arena prepares its next block on a background thread
+        // while the current one fills up, so the allocating thread neither
+        // maps nor faults memory as long as the background keeps up
+        Background
+    };
+
+    size_t blockSize = DEFAULT_BLOCK_SIZE;
+    // NUMA node the blocks are placed on, -1 leaves it to the kernel, which
+    // places memory on the node of the thread that first touches it
+    int numaNode = -1;
+    // block sizes are rounded up to whole huge pages
+    HugePages hugePages = HugePages::None;
+    Prefault prefault = Prefault::None;
+};
+
+// One block of arena memory. Blocks with a NUMA node or huge pages are
+// mapped directly; a node binds them with mbind(MPOL_PREFERRED), so they
+// fall back to another node only when the chosen one runs out of memory.
+class ArenaBlock
+{
+private:
+    char *memory = nullptr;
+    size_t bytes = 0;
+    bool mapped = false;
+
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    // writes a byte per page, which makes the kernel allocate them
+    void touch()
+    {
+        volatile char *pages = memory;
+        for (size_t offset = 0; offset < bytes; offset += PAGE_SIZE)
+        {
+            pages[offset] = 0;
+        }
+    }
+
+#if defined(__linux__)
+    static constexpr int MPOL_PREFERRED_MODE = 1;
+
+    static void *mapOrThrow(size_t bytes, int flags)
+    {
+        void *memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            throw std::system_error(errno, std::generic_category(), "mmap arena block");
+        }
+        return memory;
+    }
+
+    // maps a huge page aligned range by trimming a larger mapping
+    static char *mapAligned(size_t bytes)
+    {
+        constexpr size_t alignment = ArenaOptions::HUGE_PAGE_SIZE;
+        auto *mapping = static_cast<char *>(mapOrThrow(bytes + alignment, 0));
+        auto address = reinterpret_cast<uintptr_t>(mapping);
+        size_t head = (alignment - (address & (alignment - 1))) & (alignment - 1);
+        if (head > 0)
+        {
+            ::munmap(mapping, head);
+        }
+        ::munmap(mapping + head + bytes, alignment - head);
+        return mapping + head;
+    }
+
+    static void bindToNode(char *memory, size_t bytes, int node)
+    {
+        constexpr size_t maskBits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> nodeMask(static_cast<size_t>(node) / maskBits + 1);
+        nodeMask[static_cast<size_t>(node) / maskBits] = 1UL << (static_cast<size_t>(node) % maskBits);
+        // the kernel expects one more than the highest node bit
+        if (::syscall(SYS_mbind, memory, bytes, MPOL_PREFERRED_MODE, nodeMask.data(),
+                      nodeMask.size() * maskBits + 1, 0) != 0)
+        {
+            int error = errno;
+            ::munmap(memory, bytes);
+            throw std::system_error(error, std::generic_category(), "mbind arena block to NUMA node");
+        }
+    }
+
+    static char *map(size_t bytes, const ArenaOptions &options)
+    {
+        char *memory;
+        switch (options.hugePages)
+        {
+        case ArenaOptions::HugePages::Transparent:
+            memory = mapAligned(bytes);
+            // only a hint, kernels without transparent huge pages refuse it
+            ::madvise(memory, bytes, MADV_HUGEPAGE);
+            break;
+        case ArenaOptions::HugePages::Explicit:
+            memory = static_cast<char *>(mapOrThrow(bytes, MAP_HUGETLB));
+            break;
+        default:
+            memory = static_cast<char *>(mapOrThrow(bytes, 0));
+        }
+        if (options.numaNode >= 0)
+        {
+            bindToNode(memory, bytes, options.numaNode);
+        }
+        return memory;
+    }
+#endif
+
+public:
+    ArenaBlock(size_t bytes, const ArenaOptions &options) : bytes(bytes)
+    {
+        if (options.numaNode < 0 && options.hugePages == ArenaOptions::HugePages::None)
+        {
+            memory = new char[bytes];
+        }
+        else
+        {
+#if defined(__linux__)
+            if (options.hugePages != ArenaOptions::HugePages::None)
+            {
+                size_t pages = (bytes + ArenaOptions::HUGE_PAGE_SIZE - 1) / ArenaOptions::HUGE_PAGE_SIZE;
+                this->bytes = pages * ArenaOptions::HUGE_PAGE_SIZE;
+            }
+            memory = map(this->bytes, options);
+            mapped = true;
+#else
+            throw std::invalid_argument("NUMA placement and huge pages are only supported on Linux");
+#endif
+        }
+        if (options.prefault != ArenaOptions::Prefault::None)
+        {
+            touch();
+        }
+    }
+
+    ArenaBlock(ArenaBlock &&other) noexcept
+        : memory(std::exchange(other.memory, nullptr)), bytes(other.bytes), mapped(other.mapped)
+    {
+    }
+
+    ArenaBlock &operator=(ArenaBlock other) noexcept
+    {
+        std::swap(memory, other.memory);
+        std::swap(bytes, other.bytes);
+        std::swap(mapped, other.mapped);
+        return *this;
+    }
+
+    ~ArenaBlock()
+    {
+        if (memory == nullptr)
+        {
+            return;
+        }
+#if defined(__linux__)
+        if (mapped)
+        {
+            ::munmap(memory, bytes);
+            return;
+        }
+#endif
+        delete[] memory;
+    }
+
+    char *data() const
+    {
+        return memory;
+    }
+
+    // at least the requested size, whole huge pages with huge pages
+    size_t size() const
+    {
+        return bytes;
+    }
+};
+
+// Bump allocator that carves allocations out of large blocks. Memory is
+// returned to the system all at once by release() or the destructor;
+// small allocations handed back with deallocate() are kept on per size
+// free lists and reused. Only memoryUsage() may be called concurrently with
+// the (single) allocating thread. With Prefault::Background one block more
+// than memoryUsage() reports is held ready.
+class Arena
+{
+public:
+    // sizes are rounded up to this, allocations up to MAX_RECYCLED_SIZE
+    // are recycled by deallocate()
+    static constexpr size_t SIZE_CLASS_GRANULARITY = 8;
+    static constexpr size_t MAX_RECYCLED_SIZE = 512;
+
+private:
+    ArenaOptions options;
+    size_t blockSize;
+    char *allocPtr = nullptr;
+    size_t allocRemaining = 0;
+    std::vector<ArenaBlock> blocks;
+    // the next block of blockSize, prepared in the background with
+    // Prefault::Background
+    std::future<ArenaBlock> spare;
+    std::atomic<size_t> usage{0};
+    // intrusive lists, the first bytes of a free chunk point to the next
+    void *freeLists[MAX_RECYCLED_SIZE / SIZE_CLASS_GRANULARITY + 1] = {};
+
+    static size_t roundSize(size_t bytes)
+    {
+        return (bytes + SIZE_CLASS_GRANULARITY - 1) & ~(SIZE_CLASS_GRANULARITY - 1);
+    }
+
+    void *popFree(size_t bytes, size_t alignment, size_t hotBytes)
+    {
+        void *&list = freeLists[bytes / SIZE_CLASS_GRANULARITY];
+        auto *chunk = static_cast<char *>(list);
+        if (chunk == nullptr || place(chunk, alignment, hotBytes) != chunk)
+        {
+            return nullptr;
+        }
+        std::memcpy(&list, chunk, sizeof(void *));
+        return chunk;
+    }
+
+    void prepareSpare()
+    {
+        spare = std::async(std::launch::async, [bytes = blockSize, options = options]
+                           { return ArenaBlock(bytes, options); });
+    }
+
+    ArenaBlock &allocateNewBlock(size_t bytes)
+    {
+        if (bytes == blockSize && options.prefault == ArenaOptions::Prefault::Background)
+        {
+            if (!spare.valid())
+            {
+                prepareSpare();
+            }
+            blocks.push_back(spare.get());
+            prepareSpare();
+        }
+        else
+        {
+            blocks.emplace_back(bytes, options);
+        }
+        usage.store(usage.load(std::memory_order_relaxed) + blocks.back().size() + sizeof(ArenaBlock),
+                    std::memory_order_relaxed);
+        return blocks.back();
+    }
+
+    char *allocateFallback(size_t bytes, size_t alignment, size_t hotBytes)
+    {
+        // large objects get their own block so we do not waste the
+        // remainder of the current one
+        size_t worstCase = bytes + alignment + (hotBytes > 0 ? CACHE_LINE_SIZE : 0);
+        if (worstCase > blockSize / 4)
+        {
+            return place(allocateNewBlock(worstCase).data(), alignment, hotBytes);
+        }
+
+        ArenaBlock &block = allocateNewBlock(blockSize);
+        allocPtr = block.data();
+        allocRemaining = block.size();
+        char *result = place(allocPtr, alignment, hotBytes);
+        size_t needed = bytes + (result - allocPtr);
+        allocPtr += needed;
+        allocRemaining -= needed;
+        return result;
+    }
+
+    static char *place(char *ptr, size_t alignment, size_t hotBytes)
+    {
+        char *result = align(ptr, alignment);
+        size_t offset = reinterpret_cast<uintptr_t>(result) & (CACHE_LINE_SIZE - 1);
+        if (hotBytes <= CACHE_LINE_SIZE && offset + hotBytes > CACHE_LINE_SIZE)
+        {
+            result = align(result, CACHE_LINE_SIZE);
+        }
+        return result;
+    }
+
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = ArenaOptions::DEFAULT_BLOCK_SIZE;
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    static char *align(char *ptr, size_t alignment)
+    {
+        auto address = reinterpret_cast<uintptr_t>(ptr);
+        return ptr + ((alignment - (address & (alignment - 1))) & (alignment - 1));
+    }
+
+    explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE) : Arena(ArenaOptions{.blockSize = blockSize}) {}
+
+    explicit Arena(const ArenaOptions &options) : options(options), blockSize(options.blockSize) {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // alignment must be a power of two. If the first hotBytes of the
+    // allocation would straddle a cache line, it starts on the next line
+    // instead.
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t), size_t hotBytes = 0)
+    {
+        bytes = roundSize(bytes < sizeof(void *) ? sizeof(void *) : bytes);
+        if (bytes <= MAX_RECYCLED_SIZE)
+        {
+            if (void *chunk = popFree(bytes, alignment, hotBytes))
+            {
+                return chunk;
+            }
+        }
+        if (allocPtr)
+        {
+            char *result = place(allocPtr, alignment, hotBytes);
+            size_t needed = bytes + (result - allocPtr);
+            if (needed <= allocRemaining)
+            {
+                allocPtr += needed;
+                allocRemaining -= needed;
+                return result;
+            }
+        }
+        return allocateFallback(bytes, alignment, hotBytes);
+    }
+
+    // Makes memory from allocate(bytes) available to later allocations of
+    // the same size. Larger allocations stay reserved until release().
+    void deallocate(void *memory, size_t bytes)
+    {
+        bytes = roundSize(bytes < sizeof(void *) ? sizeof(void *) : bytes);
+        if (bytes <= MAX_RECYCLED_SIZE)
+        {
+            void *&list = freeLists[bytes / SIZE_CLASS_GRANULARITY];
+            std::memcpy(memory, &list, sizeof(void *));
+            list = memory;
+        }
+    }
+
+    void release()
+    {
+        std::fill(std::begin(freeLists), std::end(freeLists), nullptr);
+        blocks.clear();
+        allocPtr = nullptr;
+        allocRemaining = 0;
+        usage.store(0, std::memory_order_relaxed);
+    }
+
+    // bytes reserved from the system, including the unused tail of the
+    // current block
+    size_t memoryUsage() const
+    {
+        return usage.load(std::memory_order_relaxed);
+    }
+
+    size_t blockCount() const
+    {
+        return blocks.size();
+    }
+};
+
+// Arena that may be shared by several allocating threads. Allocations bump
+// an atomic offset into the current block, only installing a new block
+// takes a lock.
+class ConcurrentArena
+{
+private:
+    struct Block
+    {
+        ArenaBlock memory;
+        size_t size;
+        std::atomic<size_t> used{0};
+
+        Block(size_t size, const ArenaOptions &options) : memory(size, options), size(memory.size()) {}
+    };
+
+    ArenaOptions options;
+    size_t blockSize;
+    std::atomic<Block *> current{nullptr};
+    std::mutex blocksMutex;
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::atomic<size_t> usage{0};
+
+    Block *addBlock(size_t bytes)
+    {
+        blocks.push_back(std::make_unique<Block>(bytes, options));
+        usage.fetch_add(blocks.back()->size + sizeof(Block), std::memory_order_relaxed);
+        return blocks.back().get();
+    }
+
+public:
+    explicit ConcurrentArena(size_t blockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : ConcurrentArena(ArenaOptions{.blockSize = blockSize})
+    {
+    }
+
+    explicit ConcurrentArena(const ArenaOptions &options) : options(options), blockSize(options.blockSize) {}
+
+    ConcurrentArena(const ConcurrentArena &) = delete;
+    ConcurrentArena &operator=(const ConcurrentArena &) = delete;
+
+    // alignment must be a power of two
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        size_t reserved = bytes + alignment - 1;
+        if (reserved > blockSize / 4)
+        {
+            std::lock_guard<std::mutex> lock(blocksMutex);
+            return Arena::align(addBlock(reserved)->memory.data(), alignment);
+        }
+
+        while (true)
+        {
+            Block *block = current.load(std::memory_order_acquire);
+            if (block)
+            {
+                size_t offset = block->used.fetch_add(reserved, std::memory_order_relaxed);
+                if (offset + reserved <= block->size)
+                {
+                    return Arena::align(block->memory.data() + offset, alignment);
+                }
+            }
+
+            // only the first thread to notice the exhausted block installs
+            // a new one, everybody else retries on it
+            std::lock_guard<std::mutex> lock(blocksMutex);
+            if (current.load(std::memory_order_relaxed) == block)
+            {
+                current.store(addBlock(blockSize), std::memory_order_release);
+            }
+        }
+    }
+
+    // Must not run concurrently with allocate().
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(blocksMutex);
+        blocks.clear();
+        current.store(nullptr, std::memory_order_relaxed);
+        usage.store(0, std::memory_order_relaxed);
+    }
+
+    size_t memoryUsage() const
+    {
+        return usage.load(std::memory_order_relaxed);
+    }
+};
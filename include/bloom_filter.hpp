@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Split block bloom filter (Putze et al., "Cache-, hash- and space-efficient
+// bloom filters", in the variant Parquet and Impala use). A key selects one
+// 256-bit block and sets one bit in each of its eight 32-bit lanes.
+// Blocks are aligned to their size and never straddle cache lines, so a
+// probe costs a single cache miss. The lane bits
+// come from multiplying the hash with eight odd constants, a loop the
+// compiler turns into one vector multiply and shift.
+//
+// add() has a single writer, mayContain() may run concurrently with it.
+// The block words are atomics read with relaxed loads one at a time; a
+// probe racing with add() of the same key may miss it, like a find()
+// ordered before the upsert.
+class BlockedBloomFilter
+{
+public:
+    static constexpr size_t LANES = 8;
+
+private:
+    struct alignas(32) Block
+    {
+        // two 32-bit lanes per word
+        std::atomic<uint64_t> words[LANES / 2];
+    };
+
+    static constexpr uint32_t SALTS[LANES] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                              0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+    size_t blockCount;
+    std::unique_ptr<Block[]> blocks;
+
+    // the bits of the lower 32 hash bits, packed per word
+    static void mask(uint32_t hash, uint64_t (&words)[LANES / 2])
+    {
+        uint32_t lanes[LANES];
+        for (size_t i = 0; i < LANES; i++)
+        {
+            lanes[i] = uint32_t(1) << ((hash * SALTS[i]) >> 27);
+        }
+        for (size_t i = 0; i < LANES / 2; i++)
+        {
+            words[i] = static_cast<uint64_t>(lanes[2 * i + 1]) << 32 | lanes[2 * i];
+        }
+    }
+
+    // the upper 32 hash bits pick the block, without a division
+    const Block &block(uint64_t hash) const
+    {
+        return blocks[((hash >> 32) * blockCount) >> 32];
+    }
+
+public:
+    // Sized for expectedKeys at bitsPerKey, 10 bits give about 1% false
+    // positives.
+    explicit BlockedBloomFilter(size_t expectedKeys, size_t bitsPerKey = 10)
+    {
+        size_t bits = (expectedKeys < 1 ? 1 : expectedKeys) * (bitsPerKey < 1 ? 1 : bitsPerKey);
+        blockCount = (bits + 8 * sizeof(Block) - 1) / (8 * sizeof(Block));
+        blocks.reset(new Block[blockCount]);
+    }
+
+    BlockedBloomFilter(const BlockedBloomFilter &) = delete;
+    BlockedBloomFilter &operator=(const BlockedBloomFilter &) = delete;
+
+    // Spreads a hash from std::hash, which is the identity for integers in
+    // common standard libraries, over all 64 bits.
+    static uint64_t mix(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    // single writer only
+    void add(uint64_t hash)
+    {
+        uint64_t bits[LANES / 2];
+        mask(static_cast<uint32_t>(hash), bits);
+        Block &target = const_cast<Block &>(block(hash));
+        for (size_t i = 0; i < LANES / 2; i++)
+        {
+            target.words[i].store(target.words[i].load(std::memory_order_relaxed) | bits[i],
+                                  std::memory_order_relaxed);
+        }
+    }
+
+    // false if the hash was certainly never added
+    bool mayContain(uint64_t hash) const
+    {
+        uint64_t bits[LANES / 2];
+        mask(static_cast<uint32_t>(hash), bits);
+        const Block &target = block(hash);
+        uint64_t missing = 0;
+        for (size_t i = 0; i < LANES / 2; i++)
+        {
+            missing |= bits[i] & ~target.words[i].load(std::memory_order_relaxed);
+        }
+        return missing == 0;
+    }
+
+    size_t memoryUsage() const
+    {
+        return blockCount * sizeof(Block);
+    }
+};
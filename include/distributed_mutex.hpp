@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+#include "arena.hpp"
+
+// Reader-writer lock whose readers do not share a cache line. Every thread
+// maps to one of Slots padded reader counters, so lock_shared() only
+// touches the line of its own slot and read throughput scales with the
+// cores instead of bouncing a single counter. Writers pay for it: lock()
+// raises a flag and waits until all counters drained. Writers are
+// preferred, readers arriving while the flag is up back off until it
+// clears. Meets the SharedMutex requirements, so it works with
+// std::unique_lock and std::shared_lock.
+template <size_t Slots = 64>
+class DistributedSharedMutex
+{
+    static_assert(Slots > 0, "a distributed mutex needs at least one reader slot");
+
+private:
+    struct alignas(Arena::CACHE_LINE_SIZE) Slot
+    {
+        std::atomic<size_t> readers{0};
+    };
+
+    Slot slots[Slots];
+    alignas(Arena::CACHE_LINE_SIZE) std::atomic<bool> writer{false};
+
+    static size_t slotIndex()
+    {
+        static std::atomic<size_t> threads{0};
+        thread_local size_t index = threads.fetch_add(1, std::memory_order_relaxed) % Slots;
+        return index;
+    }
+
+    void waitForReaders() const
+    {
+        for (const Slot &slot : slots)
+        {
+            while (slot.readers.load(std::memory_order_seq_cst) != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+public:
+    DistributedSharedMutex() = default;
+
+    DistributedSharedMutex(const DistributedSharedMutex &) = delete;
+    DistributedSharedMutex &operator=(const DistributedSharedMutex &) = delete;
+
+    void lock()
+    {
+        while (writer.exchange(true, std::memory_order_seq_cst))
+        {
+            while (writer.load(std::memory_order_relaxed))
+            {
+                std::this_thread::yield();
+            }
+        }
+        waitForReaders();
+    }
+
+    bool try_lock()
+    {
+        if (writer.exchange(true, std::memory_order_seq_cst))
+        {
+            return false;
+        }
+        for (const Slot &slot : slots)
+        {
+            if (slot.readers.load(std::memory_order_seq_cst) != 0)
+            {
+                writer.store(false, std::memory_order_release);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void unlock()
+    {
+        writer.store(false, std::memory_order_release);
+    }
+
+    // The reader announces itself before it checks for a writer and the
+    // writer raises its flag before it checks for readers, both sequentially
+    // consistent, so at least one of them sees the other.
+    void lock_shared()
+    {
+        Slot &slot = slots[slotIndex()];
+        while (true)
+        {
+            slot.readers.fetch_add(1, std::memory_order_seq_cst);
+            if (!writer.load(std::memory_order_seq_cst))
+            {
+                return;
+            }
+            slot.readers.fetch_sub(1, std::memory_order_relaxed);
+            while (writer.load(std::memory_order_relaxed))
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    bool try_lock_shared()
+    {
+        Slot &slot = slots[slotIndex()];
+        slot.readers.fetch_add(1, std::memory_order_seq_cst);
+        if (!writer.load(std::memory_order_seq_cst))
+        {
+            return true;
+        }
+        slot.readers.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void unlock_shared()
+    {
+        slots[slotIndex()].readers.fetch_sub(1, std::memory_order_release);
+    }
+};
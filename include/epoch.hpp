@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Epoch based reclamation (Fraser, "Practical lock-freedom"). Readers pin
+// the current global epoch while they hold pointers into a structure; the
+// writer retires unlinked memory tagged with the epoch it was retired in
+// and frees it once the global epoch has advanced twice, which requires
+// every pinned reader to have moved on. Readers never block the writer, a
+// reader that stays pinned only delays reclamation.
+//
+// Pinning is reentrant and uses one slot per thread. Guards must be
+// destroyed by the thread that created them. retire() and reclaim() may
+// only be called by a single thread at a time.
+class EpochManager
+{
+public:
+    // threads that may hold a guard at the same time
+    static constexpr size_t MAX_THREADS = 128;
+
+private:
+    static constexpr uint64_t INACTIVE = 0;
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> epoch{INACTIVE};
+        // guards of the owning thread, only touched by that thread
+        size_t depth = 0;
+    };
+
+    struct Retired
+    {
+        void *memory;
+        size_t bytes;
+        void (*destroy)(void *);
+        uint64_t epoch;
+    };
+
+    // Process wide slot index of the calling thread. Indices are handed
+    // out densely and reused once their thread exits.
+    class ThreadIndex
+    {
+    private:
+        static std::mutex &registryMutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static std::vector<bool> &inUse()
+        {
+            static std::vector<bool> used;
+            return used;
+        }
+
+        size_t index;
+
+    public:
+        static std::atomic<size_t> &highWater()
+        {
+            static std::atomic<size_t> count{0};
+            return count;
+        }
+
+        ThreadIndex()
+        {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            auto &used = inUse();
+            index = 0;
+            while (index < used.size() && used[index])
+            {
+                index++;
+            }
+            if (index == used.size())
+            {
+                used.push_back(true);
+                highWater().store(used.size(), std::memory_order_release);
+            }
+            used[index] = true;
+        }
+
+        ~ThreadIndex()
+        {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            inUse()[index] = false;
+        }
+
+        static size_t current()
+        {
+            thread_local ThreadIndex self;
+            return self.index;
+        }
+    };
+
+    std::atomic<uint64_t> globalEpoch{1};
+    mutable Slot slots[MAX_THREADS];
+    std::vector<Retired> limbo;
+
+    Slot *enter() const
+    {
+        size_t index = ThreadIndex::current();
+        if (index >= MAX_THREADS)
+        {
+            throw std::runtime_error("more threads than EpochManager::MAX_THREADS pinned an epoch");
+        }
+
+        Slot *slot = &slots[index];
+        if (slot->depth++ == 0)
+        {
+            slot->epoch.store(globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            // the announcement must be visible before any pointer is read
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        return slot;
+    }
+
+    static void exit(Slot *slot)
+    {
+        if (--slot->depth == 0)
+        {
+            slot->epoch.store(INACTIVE, std::memory_order_release);
+        }
+    }
+
+    // advances the global epoch if every pinned thread has seen the
+    // current one
+    uint64_t tryAdvance()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t current = globalEpoch.load(std::memory_order_relaxed);
+        size_t threads = ThreadIndex::highWater().load(std::memory_order_acquire);
+        for (size_t i = 0; i < threads && i < MAX_THREADS; i++)
+        {
+            uint64_t pinned = slots[i].epoch.load(std::memory_order_acquire);
+            if (pinned != INACTIVE && pinned != current)
+            {
+                return current;
+            }
+        }
+        globalEpoch.store(current + 1, std::memory_order_release);
+        return current + 1;
+    }
+
+public:
+    // Keeps memory retired after the guard was created alive until the
+    // guard is destroyed. Copies pin the thread that makes them.
+    class Guard
+    {
+    public:
+        Guard() = default;
+
+        explicit Guard(const EpochManager &manager) : manager(&manager), slot(manager.enter()) {}
+
+        Guard(const Guard &other) : manager(other.manager), slot(other.manager ? other.manager->enter() : nullptr)
+        {
+        }
+
+        Guard(Guard &&other) noexcept : manager(other.manager), slot(other.slot)
+        {
+            other.manager = nullptr;
+            other.slot = nullptr;
+        }
+
+        Guard &operator=(Guard other) noexcept
+        {
+            std::swap(manager, other.manager);
+            std::swap(slot, other.slot);
+            return *this;
+        }
+
+        ~Guard()
+        {
+            if (slot)
+            {
+                exit(slot);
+            }
+        }
+
+    private:
+        const EpochManager *manager = nullptr;
+        Slot *slot = nullptr;
+    };
+
+    EpochManager() = default;
+
+    EpochManager(const EpochManager &) = delete;
+    EpochManager &operator=(const EpochManager &) = delete;
+
+    Guard pin() const
+    {
+        return Guard(*this);
+    }
+
+    // Hands bytes at memory, which no reader can reach anymore, over for
+    // reclamation. destroy, if given, runs right before they are freed.
+    void retire(void *memory, size_t bytes, void (*destroy)(void *) = nullptr)
+    {
+        limbo.push_back({memory, bytes, destroy, globalEpoch.load(std::memory_order_relaxed)});
+    }
+
+    // Tries to advance the epoch and passes every retired allocation no
+    // reader can still see to free(memory, bytes). Returns how many were
+    // freed.
+    template <typename Free>
+    size_t reclaim(Free &&free)
+    {
+        uint64_t current = tryAdvance();
+        size_t kept = 0;
+        for (const Retired &retired : limbo)
+        {
+            if (retired.epoch + 2 <= current)
+            {
+                if (retired.destroy)
+                {
+                    retired.destroy(retired.memory);
+                }
+                free(retired.memory, retired.bytes);
+            }
+            else
+            {
+                limbo[kept++] = retired;
+            }
+        }
+        size_t freed = limbo.size() - kept;
+        limbo.resize(kept);
+        return freed;
+    }
+
+    // Runs the destroy functions of all retired allocations regardless of
+    // their epoch and forgets them. Only safe when no guard exists.
+    void clear()
+    {
+        for (const Retired &retired : limbo)
+        {
+            if (retired.destroy)
+            {
+                retired.destroy(retired.memory);
+            }
+        }
+        limbo.clear();
+    }
+
+    // allocations retired but not yet freed
+    size_t pending() const
+    {
+        return limbo.size();
+    }
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram of non-negative integers, usually latencies in
+// nanoseconds, in the style of HdrHistogram. Values below SUB_BUCKETS are
+// counted exactly; above, every power of two is split into SUB_BUCKETS / 2
+// equal buckets, so a reported value is at most 1/64 above the recorded
+// one. The whole range of uint64_t fits in a fixed 30 KB.
+//
+// record() has a single writer. All other members may run concurrently
+// with it and then see the counts of a moment ago, which lets a monitor
+// export quantiles while a thread keeps recording.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 7;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKETS = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * (SUB_BUCKETS / 2);
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> minimum{UINT64_MAX};
+    std::atomic<uint64_t> maximum{0};
+
+    static size_t indexOf(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<size_t>(value);
+        }
+        unsigned shift = static_cast<unsigned>(std::bit_width(value)) - SUB_BUCKET_BITS;
+        return SUB_BUCKETS + (shift - 1) * (SUB_BUCKETS / 2) + static_cast<size_t>(value >> shift) - SUB_BUCKETS / 2;
+    }
+
+    // largest value counted in bucket index
+    static uint64_t highestValueOf(size_t index)
+    {
+        if (index < SUB_BUCKETS)
+        {
+            return index;
+        }
+        size_t shift = (index - SUB_BUCKETS) / (SUB_BUCKETS / 2) + 1;
+        uint64_t sub = (index - SUB_BUCKETS) % (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+        // wraps to UINT64_MAX for the last bucket
+        return ((sub + 1) << shift) - 1;
+    }
+
+    // only one thread writes a histogram, a read-modify-write is not needed
+    static void add(std::atomic<uint64_t> &counter, uint64_t delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+public:
+    LatencyHistogram() = default;
+
+    LatencyHistogram(const LatencyHistogram &other)
+    {
+        *this += other;
+    }
+
+    LatencyHistogram &operator=(const LatencyHistogram &other)
+    {
+        if (this != &other)
+        {
+            reset();
+            *this += other;
+        }
+        return *this;
+    }
+
+    void record(uint64_t value, uint64_t times = 1)
+    {
+        add(counts[indexOf(value)], times);
+        add(total, times);
+        add(sum, value * times);
+        if (value < minimum.load(std::memory_order_relaxed))
+        {
+            minimum.store(value, std::memory_order_relaxed);
+        }
+        if (value > maximum.load(std::memory_order_relaxed))
+        {
+            maximum.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    // Adds the counts of other. Like record(), the caller is the writer.
+    LatencyHistogram &operator+=(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            if (uint64_t count = other.counts[i].load(std::memory_order_relaxed))
+            {
+                add(counts[i], count);
+            }
+        }
+        add(total, other.total.load(std::memory_order_relaxed));
+        add(sum, other.sum.load(std::memory_order_relaxed));
+        uint64_t otherMinimum = other.minimum.load(std::memory_order_relaxed);
+        if (otherMinimum < minimum.load(std::memory_order_relaxed))
+        {
+            minimum.store(otherMinimum, std::memory_order_relaxed);
+        }
+        uint64_t otherMaximum = other.maximum.load(std::memory_order_relaxed);
+        if (otherMaximum > maximum.load(std::memory_order_relaxed))
+        {
+            maximum.store(otherMaximum, std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    // Writer only.
+    void reset()
+    {
+        for (auto &count : counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        minimum.store(UINT64_MAX, std::memory_order_relaxed);
+        maximum.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const
+    {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    // 0 while empty
+    uint64_t min() const
+    {
+        return count() > 0 ? minimum.load(std::memory_order_relaxed) : 0;
+    }
+
+    uint64_t max() const
+    {
+        return maximum.load(std::memory_order_relaxed);
+    }
+
+    double mean() const
+    {
+        uint64_t n = count();
+        return n > 0 ? static_cast<double>(sum.load(std::memory_order_relaxed)) / static_cast<double>(n) : 0;
+    }
+
+    // Smallest value at least a fraction q of the recorded values are not
+    // above, as the top of its bucket; quantile(0.99) is the p99. 0 while
+    // empty.
+    uint64_t quantile(double q) const
+    {
+        uint64_t n = count();
+        if (n == 0)
+        {
+            return 0;
+        }
+        auto rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(n)));
+        rank = rank < 1 ? 1 : (rank > n ? n : rank);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                uint64_t value = highestValueOf(i);
+                return value < max() ? value : max();
+            }
+        }
+        // counts raced ahead of total
+        return max();
+    }
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "epoch.hpp"
+#include "skiplist_atomic_sw.hpp"
+
+// The memtables of an LSM tree: one active SkipListAtomicSingleWriter
+// taking writes and the immutable lists it replaced, waiting to be
+// flushed. Once the active list's arena reaches the flush threshold, the
+// next upsert swaps in a fresh list without stopping readers.
+//
+// The lists in use form a version that is published with a single
+// pointer store. Readers pin an epoch before loading it, so a version they
+// can reach stays alive, and with it its lists. A list is destroyed when
+// the last version referencing it is reclaimed and nobody else holds it,
+// which releases its arena at once, no reader ever waits for that.
+//
+// upsert() follows the single writer contract. A flusher thread takes
+// immutable lists with immutables() and drops them with release() once
+// they are persisted. Erasing is not supported: removing a key from the
+// active list would expose older values in the immutable ones, use
+// VersionedSkipList tombstones for that.
+template <typename TKey, typename TVal, typename Branching = BranchingHalf,
+          typename Comparator = DefaultComparator<TKey>>
+class MemtableSet
+{
+public:
+    using List = SkipListAtomicSingleWriter<TKey, TVal, Branching, Comparator>;
+
+private:
+    struct Version
+    {
+        std::shared_ptr<List> active;
+        // newest first
+        std::vector<std::shared_ptr<List>> immutables;
+    };
+
+    size_t height;
+    size_t flushBytes;
+    size_t arenaBlockSize;
+
+    EpochManager epochs;
+    std::atomic<Version *> current;
+    // the writer's shortcut to the active list of the current version,
+    // which only the writer replaces
+    List *active;
+    // serializes version changes of the writer and the flusher
+    std::mutex versionMutex;
+    std::function<void()> onRotate;
+
+    static void destroyVersion(void *memory)
+    {
+        delete static_cast<Version *>(memory);
+    }
+
+    std::shared_ptr<List> createList() const
+    {
+        auto list = std::make_shared<List>(height, arenaBlockSize);
+        list->setFlushThreshold(flushBytes);
+        return list;
+    }
+
+    // publishes next and retires the version it replaces, versionMutex held
+    void publish(Version *next)
+    {
+        Version *previous = current.load(std::memory_order_relaxed);
+        current.store(next, std::memory_order_release);
+        epochs.retire(previous, sizeof(Version), &destroyVersion);
+        reclaimVersions();
+    }
+
+    void reclaimVersions()
+    {
+        // destroyVersion already freed the memory
+        epochs.reclaim([](void *, size_t) {});
+    }
+
+public:
+    // Consistent view of the lists at the time it was taken. Holding one
+    // keeps the lists alive; it must be destroyed by the thread that
+    // created it.
+    class View
+    {
+    public:
+        // Looks k up from the newest list to the oldest.
+        std::optional<TVal> find(const TKey &k) const
+        {
+            if (auto found = version->active->find(k))
+            {
+                return found;
+            }
+            for (const auto &list : version->immutables)
+            {
+                if (auto found = list->find(k))
+                {
+                    return found;
+                }
+            }
+            return std::nullopt;
+        }
+
+        // number of lists, the active one included
+        size_t lists() const
+        {
+            return version->immutables.size() + 1;
+        }
+
+        // list i, 0 is the active list and higher indices are older
+        const List &list(size_t i) const
+        {
+            return i == 0 ? *version->active : *version->immutables[i - 1];
+        }
+
+    private:
+        friend class MemtableSet;
+
+        EpochManager::Guard guard;
+        const Version *version;
+
+        View(EpochManager::Guard guard, const Version *version) : guard(std::move(guard)), version(version) {}
+    };
+
+    // Every list gets the given height and arena block size and is rotated
+    // once its arena reserved flushBytes.
+    MemtableSet(size_t height, size_t flushBytes, size_t arenaBlockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : height(height), flushBytes(flushBytes), arenaBlockSize(arenaBlockSize)
+    {
+        auto version = new Version{createList(), {}};
+        active = version->active.get();
+        current.store(version, std::memory_order_relaxed);
+    }
+
+    MemtableSet(const MemtableSet &) = delete;
+    MemtableSet &operator=(const MemtableSet &) = delete;
+
+    // no view may exist anymore
+    ~MemtableSet()
+    {
+        epochs.clear();
+        delete current.load(std::memory_order_relaxed);
+    }
+
+    // Called on the writer thread after every rotation, to wake a flusher.
+    void setRotationCallback(std::function<void()> callback)
+    {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        onRotate = std::move(callback);
+    }
+
+    void upsert(TKey k, TVal v)
+    {
+        active->upsert(std::move(k), std::move(v));
+        if (active->flushThresholdReached())
+        {
+            rotate();
+        }
+    }
+
+    // Makes the active list immutable and starts a fresh one. Writer only.
+    void rotate()
+    {
+        std::function<void()> callback;
+        {
+            std::lock_guard<std::mutex> lock(versionMutex);
+            const Version *previous = current.load(std::memory_order_relaxed);
+            auto next = new Version{createList(), {}};
+            active = next->active.get();
+            next->immutables.reserve(previous->immutables.size() + 1);
+            next->immutables.push_back(previous->active);
+            next->immutables.insert(next->immutables.end(), previous->immutables.begin(),
+                                    previous->immutables.end());
+            publish(next);
+            callback = onRotate;
+        }
+        if (callback)
+        {
+            callback();
+        }
+    }
+
+    // The immutable lists, oldest first, the order to flush them in.
+    std::vector<std::shared_ptr<const List>> immutables()
+    {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        const Version *version = current.load(std::memory_order_relaxed);
+        return {version->immutables.rbegin(), version->immutables.rend()};
+    }
+
+    // Removes a flushed immutable list. Readers that still see it keep it
+    // alive until they move on. Returns false if list is not immutable here.
+    bool release(const List *list)
+    {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        const Version *version = current.load(std::memory_order_relaxed);
+        auto next = std::make_unique<Version>(*version);
+        auto found = std::find_if(next->immutables.begin(), next->immutables.end(),
+                                  [list](const auto &candidate) { return candidate.get() == list; });
+        if (found == next->immutables.end())
+        {
+            return false;
+        }
+        next->immutables.erase(found);
+        publish(next.release());
+        return true;
+    }
+
+    // Destroys versions, and the lists only they held, that readers have
+    // left since the last version change.
+    void reclaim()
+    {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        reclaimVersions();
+    }
+
+    View view() const
+    {
+        auto guard = epochs.pin();
+        return View(std::move(guard), current.load(std::memory_order_acquire));
+    }
+
+    std::optional<TVal> find(const TKey &k) const
+    {
+        return view().find(k);
+    }
+
+    // memory reserved by all lists of the current version
+    size_t memoryUsage() const
+    {
+        View snapshot = view();
+        size_t total = 0;
+        for (size_t i = 0; i < snapshot.lists(); i++)
+        {
+            total += snapshot.list(i).memoryUsage();
+        }
+        return total;
+    }
+};
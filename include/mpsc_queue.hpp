@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "arena.hpp"
+
+// Bounded lock-free queue for many producers and a single consumer, after
+// Vyukov's bounded MPMC queue. Every cell carries a sequence number telling
+// whether it is free for the producer claiming that position or holds a
+// value for the consumer, so producers only contend on one fetch of the
+// enqueue position and never on the cells.
+template <typename T>
+class MpscRingBuffer
+{
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(Arena::CACHE_LINE_SIZE) std::atomic<size_t> enqueuePosition{0};
+    // bumped after a cell is published, a claimed position may still be
+    // empty, so the consumer must not wait on enqueuePosition
+    alignas(Arena::CACHE_LINE_SIZE) std::atomic<size_t> published{0};
+    // only touched by the consumer
+    alignas(Arena::CACHE_LINE_SIZE) size_t dequeuePosition = 0;
+
+public:
+    // capacity is rounded up to a power of two
+    explicit MpscRingBuffer(size_t capacity)
+        : mask(std::bit_ceil(capacity < 2 ? size_t(2) : capacity) - 1), cells(new Cell[mask + 1])
+    {
+        for (size_t i = 0; i <= mask; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRingBuffer(const MpscRingBuffer &) = delete;
+    MpscRingBuffer &operator=(const MpscRingBuffer &) = delete;
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    // Returns false without moving from value if the queue is full.
+    bool tryPush(T &value)
+    {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0)
+            {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    published.fetch_add(1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                // the consumer has not freed this cell since the last lap
+                return false;
+            }
+            else
+            {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only. Returns false if the next value is not published yet.
+    bool tryPop(T &value)
+    {
+        Cell &cell = cells[dequeuePosition & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+        {
+            return false;
+        }
+        value = std::move(cell.value);
+        cell.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+        dequeuePosition++;
+        return true;
+    }
+
+    // Number of values published so far, for waitPushed(). Every value
+    // counted is visible to tryPop().
+    size_t pushed() const
+    {
+        return published.load(std::memory_order_acquire);
+    }
+
+    // Blocks the consumer until a producer publishes a value after seen.
+    void waitPushed(size_t seen) const
+    {
+        published.wait(seen, std::memory_order_acquire);
+    }
+
+    // Wakes a consumer blocked in waitPushed(), producers call it after
+    // tryPush() succeeded.
+    void notify()
+    {
+        published.notify_one();
+    }
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// NUMA topology as the Linux kernel reports it in sysfs, without linking
+// libnuma. On other systems, or without sysfs, the machine looks like a
+// single node holding every CPU.
+class NumaTopology
+{
+private:
+    // parses a sysfs list like "0-3,8,10-11"
+    static std::vector<int> parseList(const std::string &list)
+    {
+        std::vector<int> result;
+        std::stringstream stream(list);
+        std::string range;
+        while (std::getline(stream, range, ','))
+        {
+            if (range.empty() || range == "\n")
+            {
+                continue;
+            }
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int i = first; i <= last; i++)
+            {
+                result.push_back(i);
+            }
+        }
+        return result;
+    }
+
+    static std::vector<int> readList(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string list;
+        if (!file || !std::getline(file, list))
+        {
+            return {};
+        }
+        return parseList(list);
+    }
+
+public:
+    // number of nodes, node ids are assumed to be dense
+    static size_t nodes()
+    {
+        std::vector<int> online = readList("/sys/devices/system/node/online");
+        return online.empty() ? 1 : static_cast<size_t>(online.back()) + 1;
+    }
+
+    // CPUs of node, all CPUs if the topology is unknown
+    static std::vector<int> cpusOfNode(int node)
+    {
+        std::vector<int> cpus = readList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (cpus.empty() && node == 0)
+        {
+            unsigned count = std::thread::hardware_concurrency();
+            for (unsigned cpu = 0; cpu < (count == 0 ? 1 : count); cpu++)
+            {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+        return cpus;
+    }
+
+    // Every CPU once, one of each node in turn, so that pinning thread i to
+    // element i spreads consecutive threads over the nodes.
+    static std::vector<int> interleavedCpus()
+    {
+        std::vector<std::vector<int>> perNode;
+        size_t longest = 0;
+        for (size_t node = 0; node < nodes(); node++)
+        {
+            perNode.push_back(cpusOfNode(static_cast<int>(node)));
+            longest = std::max(longest, perNode.back().size());
+        }
+        std::vector<int> cpus;
+        for (size_t i = 0; i < longest; i++)
+        {
+            for (const auto &nodeCpus : perNode)
+            {
+                if (i < nodeCpus.size())
+                {
+                    cpus.push_back(nodeCpus[i]);
+                }
+            }
+        }
+        return cpus;
+    }
+
+    // node of the CPU the calling thread runs on right now
+    static int currentNode()
+    {
+#if defined(__linux__)
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        {
+            return static_cast<int>(node);
+        }
+#endif
+        return 0;
+    }
+
+    // Restricts the calling thread to the CPUs of node.
+    static void pinThreadToNode(int node)
+    {
+        std::vector<int> cpus = cpusOfNode(node);
+        if (cpus.empty())
+        {
+            throw std::invalid_argument("NUMA node " + std::to_string(node) + " has no CPUs");
+        }
+        pinThread(cpus);
+    }
+
+    // Restricts the calling thread to cpus.
+    static void pinThread(const std::vector<int> &cpus)
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            CPU_SET(cpu, &set);
+        }
+        if (int error = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set))
+        {
+            throw std::system_error(error, std::generic_category(), "pin thread");
+        }
+#else
+        (void)cpus;
+#endif
+    }
+};
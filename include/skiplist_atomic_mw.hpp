@@ -0,0 +1,309 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <memory>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+#include "arena.hpp"
+#include "skiplist_keys.hpp"
+#include "skiplist_random.hpp"
+#include "skiplist_stats.hpp"
+
+// Lock-free skiplist supporting any number of concurrent writers and
+// readers. A key is inserted by a compare-and-swap on the bottom level,
+// which decides whether the insert happens, the upper levels are linked
+// afterwards one by one and only speed up searches. Like the single writer
+// variant the list is append only. Comparator is a strict weak order on
+// keys, equal keys are those neither orders before the other.
+template <typename TKey, typename TVal, typename Branching = BranchingHalf,
+          typename Comparator = DefaultComparator<TKey>, typename Stats = NoStats>
+class SkipListAtomicMultiWriter
+{
+public:
+    static constexpr size_t MAX_HEIGHT = 32;
+
+private:
+    // Same layout as in SkipListAtomicSingleWriter.
+    struct alignas(std::atomic<void *>) Node
+    {
+        union
+        {
+            TKey k;
+        };
+        std::atomic<TVal> v;
+
+        Node(const TKey &k, TVal val) : k(k)
+        {
+            v.store(val, std::memory_order_relaxed);
+        }
+
+        Node()
+        {
+        }
+
+        ~Node()
+            requires std::is_trivially_destructible_v<TKey>
+        = default;
+
+        // the key is destroyed by the list, which knows the head
+        ~Node()
+        {
+        }
+
+        std::atomic<Node *> *nextArray()
+        {
+            return reinterpret_cast<std::atomic<Node *> *>(this + 1);
+        }
+
+        const std::atomic<Node *> *nextArray() const
+        {
+            return reinterpret_cast<const std::atomic<Node *> *>(this + 1);
+        }
+
+        Node *next(size_t level) const
+        {
+            return nextArray()[level].load(std::memory_order_acquire);
+        }
+
+        static size_t allocationSize(size_t height)
+        {
+            return sizeof(Node) + height * sizeof(std::atomic<Node *>);
+        }
+    };
+
+    size_t maxHeight;
+    std::atomic<size_t> activeHeight{1};
+    ConcurrentArena arena;
+    Node *head;
+    [[no_unique_address]] Comparator compare;
+
+    template <typename... Args>
+    Node *allocateNode(size_t nodeHeight, Args &&...args)
+    {
+        void *memory = arena.allocate(Node::allocationSize(nodeHeight), alignof(Node));
+        Node *node = new (memory) Node(std::forward<Args>(args)...);
+        for (size_t i = 0; i < nodeHeight; i++)
+        {
+            new (&node->nextArray()[i]) std::atomic<Node *>(nullptr);
+        }
+        return node;
+    }
+
+    // every writer thread draws heights from its own generator
+    static TowerHeightGenerator<Branching> &heightGenerator()
+    {
+        static std::atomic<uint64_t> seeds{XorShift64Star::DEFAULT_SEED};
+        thread_local TowerHeightGenerator<Branching> generator(
+            seeds.fetch_add(0x9E3779B97F4A7C15ull, std::memory_order_relaxed));
+        return generator;
+    }
+
+    Node *findInLevel(Node *current, size_t level, const TKey &k) const
+    {
+        Node *next = current->next(level);
+        while (next != nullptr)
+        {
+            Stats::compare();
+            if (compare(k, next->k))
+            {
+                break;
+            }
+            Stats::visit(level);
+            current = next;
+            next = current->next(level);
+        }
+        return current;
+    }
+
+    // Fills preds[level] with the last node before k and succs[level] with
+    // the first node not less than k on all levels below levels. Returns the
+    // node holding k if it is already linked on the bottom level.
+    Node *findPath(const TKey &k, size_t levels, Node **preds, Node **succs) const
+    {
+        Node *current = head;
+        Node *next = nullptr;
+        for (size_t level = levels; level-- > 0;)
+        {
+            next = current->next(level);
+            while (next != nullptr)
+            {
+                Stats::compare();
+                if (!compare(next->k, k))
+                {
+                    break;
+                }
+                Stats::visit(level);
+                current = next;
+                next = current->next(level);
+            }
+            preds[level] = current;
+            succs[level] = next;
+        }
+        return next != nullptr && !compare(k, next->k) ? next : nullptr;
+    }
+
+    void raiseHeight(size_t nodeHeight)
+    {
+        size_t current = activeHeight.load(std::memory_order_relaxed);
+        while (nodeHeight > current &&
+               !activeHeight.compare_exchange_weak(current, nodeHeight, std::memory_order_relaxed))
+        {
+        }
+    }
+
+public:
+    SkipListAtomicMultiWriter(size_t height, size_t arenaBlockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : SkipListAtomicMultiWriter(height, ArenaOptions{.blockSize = arenaBlockSize})
+    {
+    }
+
+    // arenaOptions choose block size and NUMA node of the node memory
+    SkipListAtomicMultiWriter(size_t height, const ArenaOptions &arenaOptions)
+        : maxHeight(height), arena(arenaOptions)
+    {
+        if (maxHeight == 0 || maxHeight > MAX_HEIGHT)
+        {
+            throw std::invalid_argument("skiplist height must be between 1 and MAX_HEIGHT");
+        }
+        head = allocateNode(maxHeight);
+    }
+
+    ~SkipListAtomicMultiWriter()
+    {
+        clear();
+    }
+
+    // Releases all nodes at once. Must not run concurrently with readers or
+    // writers.
+    void clear()
+    {
+        if (head == nullptr)
+        {
+            return;
+        }
+        if constexpr (!std::is_trivially_destructible_v<Node>)
+        {
+            Node *current = head->next(0);
+            while (current != nullptr)
+            {
+                Node *next = current->next(0);
+                current->k.~TKey();
+                current->~Node();
+                current = next;
+            }
+            head->~Node();
+        }
+        head = nullptr;
+        arena.release();
+    }
+
+    static size_t heightForCapacity(size_t expectedKeys)
+    {
+        double levels = std::ceil(std::log(static_cast<double>(expectedKeys < 2 ? 2 : expectedKeys)) /
+                                  -std::log(TowerHeightGenerator<Branching>::probability()));
+        size_t result = static_cast<size_t>(levels) + 1;
+        return result < MAX_HEIGHT ? result : MAX_HEIGHT;
+    }
+
+    void upsert(TKey k, TVal v)
+    {
+        [[maybe_unused]] auto timer = Stats::timeUpsert();
+        Node *preds[MAX_HEIGHT];
+        Node *succs[MAX_HEIGHT];
+
+        size_t levels = activeHeight.load(std::memory_order_relaxed);
+        if (Node *existing = findPath(k, levels, preds, succs))
+        {
+            Stats::update();
+            existing->v.store(v, std::memory_order_relaxed);
+            return;
+        }
+
+        // only inserts draw a height, updates never raise the list
+        size_t nodeHeight = heightGenerator().next(maxHeight);
+        if (nodeHeight > levels)
+        {
+            // the new levels need their predecessors too, search again
+            // from the raised top
+            raiseHeight(nodeHeight);
+            levels = activeHeight.load(std::memory_order_relaxed);
+            if (Node *existing = findPath(k, levels, preds, succs))
+            {
+                Stats::update();
+                existing->v.store(v, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        // the bottom level decides whether the key is inserted; on conflict
+        // search again, somebody may have inserted the same key meanwhile
+        Node *newNode = allocateNode(nodeHeight, k, v);
+        while (true)
+        {
+            newNode->nextArray()[0].store(succs[0], std::memory_order_relaxed);
+            if (preds[0]->nextArray()[0].compare_exchange_strong(
+                    succs[0], newNode, std::memory_order_release, std::memory_order_relaxed))
+            {
+                break;
+            }
+            if (Node *existing = findPath(k, levels, preds, succs))
+            {
+                // newNode stays unreachable in the arena
+                Stats::update();
+                existing->v.store(v, std::memory_order_relaxed);
+                return;
+            }
+        }
+        Stats::insert(nodeHeight);
+
+        for (size_t level = 1; level < nodeHeight; level++)
+        {
+            while (true)
+            {
+                newNode->nextArray()[level].store(succs[level], std::memory_order_relaxed);
+                if (preds[level]->nextArray()[level].compare_exchange_strong(
+                        succs[level], newNode, std::memory_order_release, std::memory_order_relaxed))
+                {
+                    break;
+                }
+                findPath(k, levels, preds, succs);
+            }
+        }
+    }
+
+    std::optional<TVal> find(const TKey &k) const
+    {
+        [[maybe_unused]] auto timer = Stats::timeFind();
+        Stats::find();
+        Node *current = head;
+        for (size_t level = activeHeight.load(std::memory_order_relaxed); level-- > 0;)
+        {
+            current = findInLevel(current, level, k);
+            if (current != head && !compare(current->k, k))
+            {
+                return current->v.load(std::memory_order_relaxed);
+            }
+        }
+        return std::nullopt;
+    }
+
+    size_t getHeight() const
+    {
+        return activeHeight.load(std::memory_order_relaxed);
+    }
+
+    // size of a node promoted to a single level
+    static size_t getNodeSize()
+    {
+        return Node::allocationSize(1);
+    }
+
+    size_t memoryUsage() const
+    {
+        return arena.memoryUsage();
+    }
+};
@@ -1,148 +1,1097 @@
+#pragma once
+
 #include <vector>
 #include <optional>
 #include <memory>
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "arena.hpp"
+#include "bloom_filter.hpp"
+#include "epoch.hpp"
+#include "skiplist_file.hpp"
+#include "skiplist_keys.hpp"
+#include "skiplist_random.hpp"
+#include "skiplist_stats.hpp"
 
-template <typename TKey, typename TVal>
+// Comparator is a strict weak order on keys. If it provides prefix(), see
+// PrefixComparator, nodes carry the prefix of their key and searches
+// compare prefixes before the keys themselves. Stats is NoStats or
+// CountingStats, see skiplist_stats.hpp.
+template <typename TKey, typename TVal, typename Branching = BranchingHalf,
+          typename Comparator = DefaultComparator<TKey>, typename Stats = NoStats>
 class SkipListAtomicSingleWriter
 {
+public:
+    static constexpr size_t MAX_HEIGHT = 32;
+    // lookups findBatch() interleaves
+    static constexpr size_t BATCH_IN_FLIGHT = 16;
+    // retired allocations that trigger an attempt to reclaim them
+    static constexpr size_t RECLAIM_THRESHOLD = 64;
+
 private:
-    struct Node
+    static constexpr bool HAS_PREFIX = PrefixComparator<Comparator, TKey>;
+
+    struct NoPrefix
     {
-        Node *down;
-        std::atomic<Node *> next;
-        std::optional<TKey> k;
-        std::atomic<TVal> v;
+    };
+    using Prefix = std::conditional_t<HAS_PREFIX, uint64_t, NoPrefix>;
+
+    // One node per key. The next pointers of all levels the key is promoted
+    // to are stored directly behind the node, level 0 being the bottom list.
+    // Key, value and the level 0 pointer come first so that a search on
+    // the bottom level touches a single cache line per node. Key bytes
+    // that KeyStorage copies into the list follow the next pointers.
+    struct alignas(std::atomic<void *>) Node
+    {
+        [[no_unique_address]] Prefix prefix;
+        // the head is a node whose key is never constructed, it is
+        // recognized by its address instead of a flag
+        union
+        {
+            TKey k;
+        };
+        ValueSlot<TVal> v;
+
+        Node(Prefix prefix, const TKey &k, const TVal &val, Arena &arena)
+            : prefix(prefix), k(k), v(val, arena)
+        {
+        }
+
+        Node()
+        {
+        }
+
+        ~Node()
+            requires std::is_trivially_destructible_v<TKey>
+        = default;
+
+        // the key is destroyed by the list, which knows the head
+        ~Node()
+        {
+        }
+
+        std::atomic<Node *> *nextArray()
+        {
+            return reinterpret_cast<std::atomic<Node *> *>(this + 1);
+        }
 
-        Node(Node *down, Node *next, std::optional<TKey> k, TVal val) : down(down), next(next), k(k)
+        const std::atomic<Node *> *nextArray() const
         {
-            v.store(val, std::memory_order_relaxed);
+            return reinterpret_cast<const std::atomic<Node *> *>(this + 1);
         }
 
-        Node(Node *down, Node *next) : down(down), next(next)
+        Node *next(size_t level) const
         {
+            return nextArray()[level].load(std::memory_order_acquire);
+        }
+
+        static size_t allocationSize(size_t height)
+        {
+            return sizeof(Node) + height * sizeof(std::atomic<Node *>);
         }
     };
 
-    std::vector<Node *> heads;
+    size_t maxHeight;
+    // number of levels currently in use, only ever raised by the writer
+    std::atomic<size_t> activeHeight{1};
+    Arena arena;
+    Node *head;
+    TowerHeightGenerator<Branching> heightGenerator;
+    [[no_unique_address]] Comparator compare;
+    // set by useReclamation(); readers then pin an epoch while they hold
+    // node pointers, and erased nodes are reused once no reader can still
+    // see them
+    bool reclaiming = false;
+    EpochManager epochs;
+    size_t reclaimAt = RECLAIM_THRESHOLD;
+    // bumped after every erase, tells cursors their path may be stale
+    std::atomic<uint64_t> erasures{0};
+
+    // maintained by the writer, readable by any thread
+    std::atomic<size_t> nodeCount{0};
+    std::atomic<size_t> dataBytes{0};
+    std::atomic<size_t> towerHeights[MAX_HEIGHT] = {};
+    size_t flushThreshold = SIZE_MAX;
+    std::function<void()> onFlushThreshold;
+    std::atomic<bool> thresholdReached{false};
+
+    // set once by useFilter(), readers skip the search for keys it rules out
+    std::unique_ptr<BlockedBloomFilter> filterStorage;
+    std::atomic<const BlockedBloomFilter *> filter{nullptr};
+
+    // counters have a single writer, no read-modify-write needed
+    static void add(std::atomic<size_t> &counter, size_t delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    static void subtract(std::atomic<size_t> &counter, size_t delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) - delta, std::memory_order_relaxed);
+    }
+
+    void checkFlushThreshold()
+    {
+        if (arena.memoryUsage() >= flushThreshold && !thresholdReached.load(std::memory_order_relaxed))
+        {
+            thresholdReached.store(true, std::memory_order_release);
+            if (onFlushThreshold)
+            {
+                onFlushThreshold();
+            }
+        }
+    }
 
-    Node *findInLevel(Node *current, const TKey &k) const
+    // a key searched for along with its prefix, computed once per search
+    struct SearchKey
     {
-        Node *next = current->next.load(std::memory_order_acquire);
-        while (!(next == nullptr || next->k > k))
+        const TKey &k;
+        [[no_unique_address]] Prefix prefix;
+    };
+
+    SearchKey searchKey(const TKey &k) const
+    {
+        if constexpr (HAS_PREFIX)
         {
+            return {k, Comparator::prefix(k)};
+        }
+        else
+        {
+            return {k, {}};
+        }
+    }
+
+    bool less(const SearchKey &key, const Node *node) const
+    {
+        if constexpr (HAS_PREFIX)
+        {
+            if (key.prefix != node->prefix)
+            {
+                return key.prefix < node->prefix;
+            }
+        }
+        return compare(key.k, node->k);
+    }
+
+    bool less(const Node *node, const SearchKey &key) const
+    {
+        if constexpr (HAS_PREFIX)
+        {
+            if (node->prefix != key.prefix)
+            {
+                return node->prefix < key.prefix;
+            }
+        }
+        return compare(node->k, key.k);
+    }
+
+    bool less(const Node *a, const Node *b) const
+    {
+        if constexpr (HAS_PREFIX)
+        {
+            if (a->prefix != b->prefix)
+            {
+                return a->prefix < b->prefix;
+            }
+        }
+        return compare(a->k, b->k);
+    }
+
+    // zero initialized next pointers for nodeHeight levels, followed by
+    // payloadBytes for key and value storage
+    char *allocateTower(size_t nodeHeight, size_t payloadBytes)
+    {
+        char *memory = static_cast<char *>(arena.allocate(Node::allocationSize(nodeHeight) + payloadBytes,
+                                                          alignof(Node), Node::allocationSize(1)));
+        auto *next = reinterpret_cast<std::atomic<Node *> *>(memory + sizeof(Node));
+        for (size_t i = 0; i < nodeHeight; i++)
+        {
+            new (&next[i]) std::atomic<Node *>(nullptr);
+        }
+        return memory;
+    }
+
+    Node *allocateHead(size_t nodeHeight)
+    {
+        return new (allocateTower(nodeHeight, 0)) Node();
+    }
+
+    static constexpr bool HASHABLE = requires(const TKey &k) { std::hash<TKey>{}(k); };
+
+    static uint64_t hashKey(const TKey &k)
+        requires HASHABLE
+    {
+        return BlockedBloomFilter::mix(std::hash<TKey>{}(k));
+    }
+
+    // false if the filter proves k is absent
+    bool mayContain(const TKey &k) const
+    {
+        if constexpr (HASHABLE)
+        {
+            const BlockedBloomFilter *keys = filter.load(std::memory_order_acquire);
+            return keys == nullptr || keys->mayContain(hashKey(k));
+        }
+        return true;
+    }
+
+    // every path that links a node allocates it here, before it is linked
+    Node *allocateNode(size_t nodeHeight, const TKey &k, const TVal &v)
+    {
+        if constexpr (HASHABLE)
+        {
+            if (filterStorage)
+            {
+                filterStorage->add(hashKey(k));
+            }
+        }
+
+        size_t nodeBytes = Node::allocationSize(nodeHeight) + KeyStorage<TKey>::payloadSize(k);
+        char *memory = allocateTower(nodeHeight, KeyStorage<TKey>::payloadSize(k));
+        const TKey &stored = KeyStorage<TKey>::store(k, memory + Node::allocationSize(nodeHeight));
+        Node *node = new (memory) Node(searchKey(stored).prefix, stored, v, arena);
+
+        add(nodeCount, 1);
+        add(dataBytes, nodeBytes + node->v.record().bytes);
+        add(towerHeights[nodeHeight - 1], 1);
+        checkFlushThreshold();
+        return node;
+    }
+
+    void updateValue(Node *node, const TVal &v)
+    {
+        SlotRecord previous = node->v.store(v, arena);
+        add(dataBytes, node->v.record().bytes);
+        subtract(dataBytes, previous.bytes);
+        retire(previous);
+        checkFlushThreshold();
+    }
+
+    static void destroyNode(void *memory)
+    {
+        Node *node = static_cast<Node *>(memory);
+        node->k.~TKey();
+        node->~Node();
+    }
+
+    // without reclamation replaced values stay in the arena until clear()
+    void retire(void *memory, size_t bytes, void (*destroy)(void *) = nullptr)
+    {
+        if (!reclaiming)
+        {
+            return;
+        }
+        epochs.retire(memory, bytes, destroy);
+        if (epochs.pending() >= reclaimAt)
+        {
+            epochs.reclaim([this](void *memory, size_t bytes) { arena.deallocate(memory, bytes); });
+            // readers pinned for long keep memory in limbo, back off so
+            // that every retire does not rescan it
+            reclaimAt = std::max(RECLAIM_THRESHOLD, 2 * epochs.pending());
+        }
+    }
+
+    void retire(SlotRecord record)
+    {
+        if (record.memory != nullptr)
+        {
+            retire(record.memory, record.bytes);
+        }
+    }
+
+    // an empty guard unless the list reclaims memory
+    EpochManager::Guard pinEpoch() const
+    {
+        return reclaiming ? epochs.pin() : EpochManager::Guard();
+    }
+
+    // last node on the level with a key not greater than key
+    Node *findInLevel(Node *current, size_t level, const SearchKey &key) const
+    {
+        Node *next = current->next(level);
+        while (next != nullptr)
+        {
+            Stats::compare();
+            if (less(key, next))
+            {
+                break;
+            }
+            Stats::visit(level);
             current = next;
-            next = current->next.load(std::memory_order_acquire);
+            next = current->next(level);
         }
         return current;
     }
 
-    Node *upsertRec(Node *current, TKey k, TVal v)
+    // first node with a key not less than k
+    Node *findGreaterOrEqual(const SearchKey &key) const
     {
-        if (!current)
-            return nullptr;
+        Node *current = head;
+        Node *next = nullptr;
+        for (size_t level = activeHeight.load(std::memory_order_relaxed); level-- > 0;)
+        {
+            next = current->next(level);
+            while (next != nullptr && less(next, key))
+            {
+                current = next;
+                next = current->next(level);
+            }
+        }
+        return next;
+    }
+
+    // Inserts or updates k. finger holds per level a node to start the
+    // search from, the head or any node of that level with a key not greater
+    // than k, and is advanced to the predecessors of k. With climb set the
+    // search starts at the bottom and only moves up while a level's
+    // successor does not pass k, which suits fingers left by a smaller key.
+    void upsertFrom(Node **finger, const TKey &k, const TVal &v, bool climb)
+    {
+        SearchKey key = searchKey(k);
+        size_t currentHeight = activeHeight.load(std::memory_order_relaxed);
+        size_t level = currentHeight - 1;
+        if (climb)
+        {
+            // fingers above the level we stop at are still predecessors of
+            // k: a node between them and k would also be a successor on the
+            // lower level that did not pass k
+            level = 0;
+            while (level + 1 < currentHeight)
+            {
+                Node *next = finger[level]->next(level);
+                if (next == nullptr || less(key, next))
+                {
+                    break;
+                }
+                level++;
+            }
+        }
 
-        Node *insertNode = findInLevel(current, k);
+        Node *current = finger[level];
+        for (level++; level-- > 0;)
+        {
+            // continue from whichever of the level above and the finger is
+            // further ahead, the head is behind any node
+            if (finger[level] != head && (current == head || less(current, finger[level])))
+            {
+                current = finger[level];
+            }
+            current = findInLevel(current, level, key);
+            finger[level] = current;
 
-        // update case
-        if (insertNode->k && insertNode->k == k)
+            // update case, the tower holds a single copy of the value;
+            // current is not greater than key, so it is equal unless less
+            if (current != head && !less(current, key))
+            {
+                Stats::update();
+                updateValue(current, v);
+                return;
+            }
+        }
+
+        // link bottom up so a node reachable at some level is always
+        // reachable on all levels below
+        size_t nodeHeight = heightGenerator.next(maxHeight);
+        if (nodeHeight > currentHeight)
         {
-            insertNode->v.store(v, std::memory_order_relaxed);
-            upsertRec(insertNode->down, k, v);
-            return nullptr;
+            // readers that see the new height before the node is linked
+            // find null pointers in the head and simply move down
+            for (size_t level = currentHeight; level < nodeHeight; level++)
+            {
+                finger[level] = head;
+            }
+            activeHeight.store(nodeHeight, std::memory_order_relaxed);
         }
 
-        // we need an insert at the leaf level
-        if (!insertNode->down)
+        Stats::insert(nodeHeight);
+        Node *newNode = allocateNode(nodeHeight, k, v);
+        for (size_t level = 0; level < nodeHeight; level++)
         {
-            auto newNode = new Node(nullptr, nullptr, k, v);
-            return chainNode(insertNode, newNode);
+            chainNode(finger[level], newNode, level);
+            finger[level] = newNode;
         }
+    }
+
+    static void prefetch(const void *address)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#else
+        (void)address;
+#endif
+    }
 
-        auto childNode = upsertRec(insertNode->down, k, v);
-        if (!childNode)
+    // Runs up to BATCH_IN_FLIGHT searches in lock step. Each round moves
+    // every unfinished search by one node and prefetches the node it will
+    // look at next, so the cache misses of all searches overlap.
+    void findGroup(const TKey *keys, std::optional<TVal> *out, size_t count) const
+    {
+        Node *current[BATCH_IN_FLIGHT];
+        size_t level[BATCH_IN_FLIGHT];
+        bool done[BATCH_IN_FLIGHT];
+        [[maybe_unused]] Prefix prefix[BATCH_IN_FLIGHT];
+
+        size_t top = activeHeight.load(std::memory_order_relaxed) - 1;
+        for (size_t i = 0; i < count; i++)
         {
-            return nullptr;
+            prefix[i] = searchKey(keys[i]).prefix;
+            current[i] = head;
+            level[i] = top;
+            done[i] = !mayContain(keys[i]);
+            out[i] = std::nullopt;
         }
 
-        // insert at higher level with p=0.5
-        if (rand() & 1)
+        size_t remaining = static_cast<size_t>(std::count(done, done + count, false));
+        while (remaining > 0)
         {
-            auto newNode = new Node(childNode, nullptr, k, v);
-            return chainNode(insertNode, newNode);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (done[i])
+                {
+                    continue;
+                }
+
+                SearchKey key{keys[i], prefix[i]};
+                Node *next = current[i]->next(level[i]);
+                if (!(next == nullptr || less(key, next)))
+                {
+                    current[i] = next;
+                    prefetch(next->nextArray()[level[i]].load(std::memory_order_relaxed));
+                    continue;
+                }
+
+                if (current[i] != head && !less(current[i], key))
+                {
+                    out[i] = current[i]->v.load();
+                    done[i] = true;
+                }
+                else if (level[i] == 0)
+                {
+                    done[i] = true;
+                }
+                else
+                {
+                    level[i]--;
+                    prefetch(current[i]->nextArray()[level[i]].load(std::memory_order_relaxed));
+                }
+                remaining -= done[i];
+            }
         }
-        return nullptr;
     }
 
-    Node *chainNode(Node *previous, Node *newNode)
+    void chainNode(Node *previous, Node *newNode, size_t level)
     {
-        newNode->next.store(previous->next.load(), std::memory_order_relaxed);
-        previous->next.store(newNode, std::memory_order_release);
-        return newNode;
+        newNode->nextArray()[level].store(previous->next(level), std::memory_order_relaxed);
+        previous->nextArray()[level].store(newNode, std::memory_order_release);
     }
 
 public:
-    SkipListAtomicSingleWriter(size_t height)
+    // Forward iterator over the bottom level. Readers walk the list without
+    // locks while the writer inserts and erases: an iterator never becomes
+    // invalid and sees a concurrently inserted key only if it is linked
+    // before the iterator passes its position. Keys and values of the nodes
+    // visited are always fully initialized. With reclamation iterators pin
+    // an epoch, so holding one delays the reuse of erased nodes; they must
+    // be destroyed by the thread that created them.
+    class Iterator
     {
-        Node *prev = nullptr;
-        for (size_t i = 0; i < height; i++)
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<TKey, TVal>;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+
+        Iterator() = default;
+
+        const TKey &key() const
+        {
+            return node->k;
+        }
+
+        TVal value() const
+        {
+            return node->v.load();
+        }
+
+        value_type operator*() const
+        {
+            return {key(), value()};
+        }
+
+        Iterator &operator++()
         {
-            auto newNode = new Node(nullptr, nullptr);
-            if (prev)
+            node = node->next(0);
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator &other) const
+        {
+            return node == other.node;
+        }
+
+        bool operator!=(const Iterator &other) const
+        {
+            return node != other.node;
+        }
+
+    private:
+        friend class SkipListAtomicSingleWriter;
+
+        Iterator(const Node *node, EpochManager::Guard guard) : node(node), guard(std::move(guard)) {}
+
+        const Node *node = nullptr;
+        EpochManager::Guard guard;
+    };
+
+    // Remembers the search path of the previous lookup so that lookups for
+    // nearby keys, in either direction, start close to their target instead
+    // of at the head. The path is only read with the same acquire loads as
+    // find(), so a cursor stays valid while the writer inserts. Like an
+    // iterator a cursor may pin an epoch for its whole lifetime, it must be
+    // used and destroyed by the thread that created it and must not
+    // outlive the list.
+    class Cursor
+    {
+    public:
+        explicit Cursor(const SkipListAtomicSingleWriter &list) : list(&list), guard(list.pinEpoch())
+        {
+        }
+
+        std::optional<TVal> find(const TKey &k)
+        {
+            SearchKey key = list->searchKey(k);
+            Node *node = locate(key);
+            if (node == nullptr || list->less(key, node))
+            {
+                return std::nullopt;
+            }
+            return node->v.load();
+        }
+
+        // iterator to the first key not less than k
+        Iterator seek(const TKey &k)
+        {
+            return Iterator(locate(list->searchKey(k)), guard);
+        }
+
+    private:
+        const SkipListAtomicSingleWriter *list;
+        EpochManager::Guard guard;
+        // erasures when the path was taken, an erased node in the path
+        // no longer sees keys inserted next to it
+        uint64_t pathErasures = 0;
+        // path[level] is the last node before the previous target on that
+        // level, the head where no such node exists
+        Node *path[MAX_HEIGHT];
+        size_t pathHeight = 0;
+
+        bool isBefore(const Node *node, const SearchKey &key) const
+        {
+            return node == list->head || list->less(node, key);
+        }
+
+        Node *locate(const SearchKey &key)
+        {
+            uint64_t erasures = list->erasures.load(std::memory_order_acquire);
+            if (erasures != pathErasures)
+            {
+                pathHeight = 0;
+                pathErasures = erasures;
+            }
+
+            size_t levels = list->activeHeight.load(std::memory_order_relaxed);
+            for (; pathHeight < levels; pathHeight++)
+            {
+                path[pathHeight] = list->head;
+            }
+
+            // climb while the remembered node cannot serve k, because it is
+            // past k or its successor on this level still is before k
+            size_t level = 0;
+            while (level + 1 < levels)
+            {
+                if (isBefore(path[level], key))
+                {
+                    Node *next = path[level]->next(level);
+                    if (next == nullptr || !list->less(next, key))
+                    {
+                        break;
+                    }
+                }
+                level++;
+            }
+
+            Node *current = isBefore(path[level], key) ? path[level] : list->head;
+            Node *next = nullptr;
+            for (level++; level-- > 0;)
+            {
+                if (path[level] != list->head && list->less(path[level], key) &&
+                    (current == list->head || list->less(current, path[level])))
+                {
+                    current = path[level];
+                }
+                next = current->next(level);
+                while (next != nullptr && list->less(next, key))
+                {
+                    current = next;
+                    next = current->next(level);
+                }
+                path[level] = current;
+            }
+            return next;
+        }
+    };
+
+    // height is the maximum tower height, searches only descend through the
+    // levels that are actually in use
+    SkipListAtomicSingleWriter(size_t height, size_t arenaBlockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : SkipListAtomicSingleWriter(height, ArenaOptions{.blockSize = arenaBlockSize})
+    {
+    }
+
+    // arenaOptions choose block size and NUMA node of the node memory
+    SkipListAtomicSingleWriter(size_t height, const ArenaOptions &arenaOptions)
+        : maxHeight(height), arena(arenaOptions)
+    {
+        if (maxHeight == 0 || maxHeight > MAX_HEIGHT)
+        {
+            throw std::invalid_argument("skiplist height must be between 1 and MAX_HEIGHT");
+        }
+        head = allocateHead(maxHeight);
+    }
+
+    // Builds the list from (key, value) pairs in ascending key order in a
+    // single pass. The i-th distinct key gets one level per power of 1/p
+    // dividing i, which yields a perfectly balanced list with its nodes
+    // laid out back to back in the arena. Duplicates keep the last value,
+    // keys out of order fall back to a regular upsert.
+    template <std::input_iterator It>
+    SkipListAtomicSingleWriter(size_t height, It begin, It end, size_t arenaBlockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : SkipListAtomicSingleWriter(height, arenaBlockSize)
+    {
+        build(begin, end);
+    }
+
+    // arenaOptions choose block size, NUMA node, huge pages and prefaulting
+    // of the node memory
+    template <std::input_iterator It>
+    SkipListAtomicSingleWriter(size_t height, It begin, It end, const ArenaOptions &arenaOptions)
+        : SkipListAtomicSingleWriter(height, arenaOptions)
+    {
+        build(begin, end);
+    }
+
+private:
+    template <std::input_iterator It>
+    void build(It begin, It end)
+    {
+        const size_t spacing = static_cast<size_t>(std::lround(1 / TowerHeightGenerator<Branching>::probability()));
+
+        Node *tails[MAX_HEIGHT];
+        std::fill_n(tails, maxHeight, head);
+        size_t count = 0;
+        for (; begin != end; ++begin)
+        {
+            // iterators may return their pairs by value, keep it alive
+            auto &&entry = *begin;
+            const TKey &k = std::get<0>(entry);
+            const TVal &v = std::get<1>(entry);
+            SearchKey key = searchKey(k);
+            if (tails[0] != head && !less(tails[0], key))
             {
-                prev->down = newNode;
+                if (!less(key, tails[0]))
+                {
+                    updateValue(tails[0], v);
+                    continue;
+                }
+
+                // the inserted node may have become the tail of upper levels
+                upsert(k, v);
+                for (size_t level = 0; level < activeHeight.load(std::memory_order_relaxed); level++)
+                {
+                    while (Node *next = tails[level]->next(level))
+                    {
+                        tails[level] = next;
+                    }
+                }
+                continue;
+            }
+
+            count++;
+            size_t nodeHeight = 1;
+            for (size_t i = count; i % spacing == 0 && nodeHeight < maxHeight; i /= spacing)
+            {
+                nodeHeight++;
+            }
+            if (nodeHeight > activeHeight.load(std::memory_order_relaxed))
+            {
+                activeHeight.store(nodeHeight, std::memory_order_relaxed);
+            }
+
+            Node *newNode = allocateNode(nodeHeight, k, v);
+            for (size_t level = 0; level < nodeHeight; level++)
+            {
+                tails[level]->nextArray()[level].store(newNode, std::memory_order_release);
+                tails[level] = newNode;
             }
-            prev = newNode;
-            heads.push_back(newNode);
         }
     }
 
+public:
+    // maximum height that keeps searches logarithmic for up to
+    // expectedKeys keys
+    static size_t heightForCapacity(size_t expectedKeys)
+    {
+        double levels = std::ceil(std::log(static_cast<double>(expectedKeys < 2 ? 2 : expectedKeys)) /
+                                  -std::log(TowerHeightGenerator<Branching>::probability()));
+        size_t result = static_cast<size_t>(levels) + 1;
+        return result < MAX_HEIGHT ? result : MAX_HEIGHT;
+    }
+
     ~SkipListAtomicSingleWriter()
     {
         clear();
     }
 
+    // Releases all nodes at once. Must not run concurrently with readers.
     void clear()
     {
-        for (int i = 0; i < heads.size(); i++)
+        if (head == nullptr)
+        {
+            return;
+        }
+        epochs.clear();
+        if constexpr (!std::is_trivially_destructible_v<Node>)
         {
-            Node *current = heads[i];
-            Node *next = heads[i]->next.load(std::memory_order_acquire);
+            Node *current = head->next(0);
             while (current != nullptr)
             {
-                delete current;
+                Node *next = current->next(0);
+                current->k.~TKey();
+                current->~Node();
                 current = next;
-                if (current == nullptr)
-                    break;
-                next = current->next.load(std::memory_order_acquire);
             }
+            head->~Node();
         }
-        heads.clear();
+        head = nullptr;
+        arena.release();
     }
 
     void upsert(TKey k, TVal v)
     {
-        upsertRec(heads[0], k, v);
+        [[maybe_unused]] auto timer = Stats::timeUpsert();
+        Node *finger[MAX_HEIGHT];
+        std::fill_n(finger, maxHeight, head);
+        upsertFrom(finger, k, v, false);
     }
 
-    std::optional<TVal> find(const TKey &k) const
+    // Removes k and returns whether it was present. The node is unlinked
+    // top down, readers already positioned on it still find their way
+    // forward, and its memory is reused once every reader pinned at the
+    // time has moved on. Requires useReclamation().
+    bool erase(const TKey &k)
+    {
+        if (!reclaiming)
+        {
+            throw std::logic_error("erase requires useReclamation()");
+        }
+        SearchKey key = searchKey(k);
+        Node *preds[MAX_HEIGHT];
+        Node *target = nullptr;
+        Node *current = head;
+        size_t levels = activeHeight.load(std::memory_order_relaxed);
+        for (size_t level = levels; level-- > 0;)
+        {
+            Node *next = current->next(level);
+            while (next != nullptr && less(next, key))
+            {
+                current = next;
+                next = current->next(level);
+            }
+            preds[level] = current;
+            if (next != nullptr && !less(key, next))
+            {
+                target = next;
+            }
+        }
+        if (target == nullptr)
+        {
+            return false;
+        }
+
+        size_t nodeHeight = 0;
+        while (nodeHeight < levels && preds[nodeHeight]->next(nodeHeight) == target)
+        {
+            nodeHeight++;
+        }
+        for (size_t level = nodeHeight; level-- > 0;)
+        {
+            preds[level]->nextArray()[level].store(target->next(level), std::memory_order_release);
+        }
+        erasures.store(erasures.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+        size_t nodeBytes = Node::allocationSize(nodeHeight) + KeyStorage<TKey>::payloadSize(target->k);
+        subtract(nodeCount, 1);
+        subtract(dataBytes, nodeBytes + target->v.record().bytes);
+        subtract(towerHeights[nodeHeight - 1], 1);
+
+        retire(target->v.record());
+        retire(target, nodeBytes, std::is_trivially_destructible_v<Node> ? nullptr : &destroyNode);
+        return true;
+    }
+
+    // Upserts a range of (key, value) pairs. The batch is sorted first
+    // unless it already is, later duplicates win. Each key continues the
+    // search from the predecessors of the previous one, so presorted runs
+    // cost little more than appending to a linked list. Checking the order
+    // takes a pass of its own, so the range must be a forward range.
+    template <std::forward_iterator It>
+    void upsertBatch(It begin, It end)
     {
-        auto matchingNode = findInLevel(heads[0], k);
-        while (matchingNode->down)
+        auto keyLess = [this](const auto &a, const auto &b)
+        {
+            return compare(std::get<0>(a), std::get<0>(b));
+        };
+
+        Node *finger[MAX_HEIGHT];
+        std::fill_n(finger, maxHeight, head);
+        if (std::is_sorted(begin, end, keyLess))
+        {
+            for (; begin != end; ++begin)
+            {
+                auto &&entry = *begin;
+                upsertFrom(finger, std::get<0>(entry), std::get<1>(entry), true);
+            }
+            return;
+        }
+
+        std::vector<std::pair<TKey, TVal>> sorted(begin, end);
+        std::stable_sort(sorted.begin(), sorted.end(), keyLess);
+        for (const auto &[k, v] : sorted)
         {
-            if (matchingNode->k && matchingNode->k == k)
-                return matchingNode->v.load(std::memory_order_relaxed);
-            matchingNode = findInLevel(matchingNode->down, k);
+            upsertFrom(finger, k, v, true);
         }
-        if (!matchingNode->k || matchingNode->k != k)
+    }
+
+    std::optional<TVal> find(const TKey &k) const
+    {
+        [[maybe_unused]] auto timer = Stats::timeFind();
+        if (!mayContain(k))
         {
             return std::nullopt;
         }
-        return matchingNode->v.load(std::memory_order_relaxed);
+        auto guard = pinEpoch();
+        Stats::find();
+        SearchKey key = searchKey(k);
+        Node *current = head;
+        for (size_t level = activeHeight.load(std::memory_order_relaxed); level-- > 0;)
+        {
+            current = findInLevel(current, level, key);
+            if (current != head && !less(current, key))
+            {
+                return current->v.load();
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Looks up all keys, out[i] receives the value of keys[i]. Interleaves
+    // the searches of several keys to hide memory latency, which pays off
+    // for multi-gets on lists that do not fit in cache.
+    void findBatch(std::span<const TKey> keys, std::span<std::optional<TVal>> out) const
+    {
+        if (out.size() < keys.size())
+        {
+            throw std::invalid_argument("findBatch output is smaller than the key batch");
+        }
+        auto guard = pinEpoch();
+        for (size_t i = 0; i < keys.size(); i += BATCH_IN_FLIGHT)
+        {
+            size_t count = keys.size() - i < BATCH_IN_FLIGHT ? keys.size() - i : BATCH_IN_FLIGHT;
+            findGroup(keys.data() + i, out.data() + i, count);
+        }
+    }
+
+    Cursor cursor() const
+    {
+        return Cursor(*this);
+    }
+
+    Iterator begin() const
+    {
+        auto guard = pinEpoch();
+        return Iterator(head->next(0), std::move(guard));
+    }
+
+    Iterator end() const
+    {
+        return Iterator();
+    }
+
+    // iterator to the first key not less than k
+    Iterator seek(const TKey &k) const
+    {
+        auto guard = pinEpoch();
+        return Iterator(findGreaterOrEqual(searchKey(k)), std::move(guard));
+    }
+
+    // Calls callback(key, value) for every key in [from, to) in order.
+    template <typename Callback>
+    void scan(const TKey &from, const TKey &to, Callback &&callback) const
+    {
+        auto guard = pinEpoch();
+        SearchKey end = searchKey(to);
+        for (Node *node = findGreaterOrEqual(searchKey(from)); node != nullptr && less(node, end);
+             node = node->next(0))
+        {
+            callback(node->k, node->v.load());
+        }
     }
 
+    // Writes all keys in order to a sorted file at path, see
+    // skiplist_file.hpp, and returns how many. Reads the bottom level like an
+    // iterator, so it may run beside the writer and then includes the
+    // writes linked before it passed their position; flush a list that no
+    // longer takes writes to get an exact copy.
+    size_t flush(const std::string &path, SortedFileOptions options = {}) const
+        requires FileEncodable<TKey> && FileEncodable<TVal>
+    {
+        auto guard = pinEpoch();
+        SortedFileWriter<TKey, TVal> writer(path, options);
+        for (Node *node = head->next(0); node != nullptr; node = node->next(0))
+        {
+            writer.add(node->k, node->v.load());
+        }
+        return static_cast<size_t>(writer.finish());
+    }
+
+    // number of levels currently in use
+    size_t getHeight() const
+    {
+        return activeHeight.load(std::memory_order_relaxed);
+    }
+
+    // size of a node promoted to a single level
     static size_t getNodeSize()
     {
-        return sizeof(Node);
+        return Node::allocationSize(1);
+    }
+
+    // Keeps erased nodes and replaced values alive while the guard exists,
+    // for callers holding on to views of string keys or values. Empty
+    // without reclamation, views then stay valid until clear().
+    EpochManager::Guard pin() const
+    {
+        return pinEpoch();
+    }
+
+    // Bytes reserved by the node arena. Safe to call from any thread.
+    size_t memoryUsage() const
+    {
+        return arena.memoryUsage();
+    }
+
+    struct MemoryStats
+    {
+        // keys in the list
+        size_t nodes;
+        // bytes of live nodes, key copies and value records
+        size_t dataBytes;
+        // bytes reserved by the arena, see memoryUsage()
+        size_t reservedBytes;
+        // towerHeights[i] nodes have i + 1 levels
+        size_t towerHeights[MAX_HEIGHT];
+        // bytes of the filter, 0 without one
+        size_t filterBytes;
+    };
+
+    // Snapshot of the counters the writer maintains. Safe to call from any
+    // thread, the fields are read one by one while the writer may go on.
+    MemoryStats memoryStats() const
+    {
+        MemoryStats stats;
+        stats.nodes = nodeCount.load(std::memory_order_relaxed);
+        stats.dataBytes = dataBytes.load(std::memory_order_relaxed);
+        stats.reservedBytes = arena.memoryUsage();
+        const BlockedBloomFilter *keys = filter.load(std::memory_order_acquire);
+        stats.filterBytes = keys != nullptr ? keys->memoryUsage() : 0;
+        for (size_t i = 0; i < MAX_HEIGHT; i++)
+        {
+            stats.towerHeights[i] = towerHeights[i].load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+    // Lets erase() remove keys and reuse the memory of erased nodes and
+    // replaced values. Must be called before the list is shared with
+    // readers. From then on every lookup, iterator and cursor pins an
+    // epoch, which costs a fence per lookup and allows at most
+    // EpochManager::MAX_THREADS reader threads at a time. Append only
+    // lists, such as memtables, do without it.
+    void useReclamation()
+    {
+        reclaiming = true;
+    }
+
+    bool reclaimsMemory() const
+    {
+        return reclaiming;
+    }
+
+    // Puts a bloom filter sized for expectedKeys in front of find() and
+    // findBatch(), so most lookups of absent keys return without searching.
+    // Must be called by the writer, at most once; keys already in the list
+    // are added to the filter before readers see it. Erased keys stay in the
+    // filter and only cost a search.
+    void useFilter(size_t expectedKeys, size_t bitsPerKey = 10)
+        requires HASHABLE
+    {
+        if (filterStorage)
+        {
+            throw std::logic_error("skiplist already uses a filter");
+        }
+        auto keys = std::make_unique<BlockedBloomFilter>(expectedKeys, bitsPerKey);
+        for (Node *node = head->next(0); node != nullptr; node = node->next(0))
+        {
+            keys->add(hashKey(node->k));
+        }
+        filterStorage = std::move(keys);
+        filter.store(filterStorage.get(), std::memory_order_release);
+    }
+
+    // Once memoryUsage() reaches bytes, flushThresholdReached() turns true
+    // and callback, if any, runs once on the writer thread right after the
+    // write that crossed the threshold, e.g. to rotate memtables. Must be
+    // called by the writer, checks the current usage immediately.
+    void setFlushThreshold(size_t bytes, std::function<void()> callback = nullptr)
+    {
+        flushThreshold = bytes;
+        onFlushThreshold = std::move(callback);
+        thresholdReached.store(false, std::memory_order_relaxed);
+        checkFlushThreshold();
+    }
+
+    // Safe to call from any thread.
+    bool flushThresholdReached() const
+    {
+        return thresholdReached.load(std::memory_order_acquire);
     }
 };
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "arena.hpp"
+#include "skiplist_keys.hpp"
+#include "skiplist_random.hpp"
+#include "skiplist_stats.hpp"
+
+// Concurrency policies of BasicSkipList. A policy decides which locks
+// finds and upserts take, a policy without a mutex compiles them away.
+namespace skiplist_policy
+{
+struct NoMutex
+{
+};
+
+struct NoLock
+{
+};
+} // namespace skiplist_policy
+
+// One thread at a time, no locks.
+struct SingleThreaded
+{
+    using Mutex = skiplist_policy::NoMutex;
+
+    static skiplist_policy::NoLock lockShared(Mutex &)
+    {
+        return {};
+    }
+
+    static skiplist_policy::NoLock lock(Mutex &)
+    {
+        return {};
+    }
+};
+
+// Any number of threads, finds share the lock and upserts hold it alone.
+// Mutex is any SharedMutex, such as std::shared_mutex or
+// DistributedSharedMutex.
+template <typename SharedMutex = std::shared_mutex>
+struct Locked
+{
+    using Mutex = SharedMutex;
+
+    static std::shared_lock<Mutex> lockShared(Mutex &mutex)
+    {
+        return std::shared_lock<Mutex>(mutex);
+    }
+
+    static std::unique_lock<Mutex> lock(Mutex &mutex)
+    {
+        return std::unique_lock<Mutex>(mutex);
+    }
+};
+
+// The skiplist behind SkipList and SkipListMutex, specialized at compile
+// time. ConcurrencyPolicy is SingleThreaded or Locked<Mutex>; for lock-free
+// readers use SkipListAtomicSingleWriter or SkipListAtomicMultiWriter.
+// Allocator provides allocate(bytes, alignment, hotBytes), release() and
+// memoryUsage() like Arena. MaxHeight bounds the height, the search path
+// lives in a MaxHeight array on the stack. Stats is NoStats, CountingStats
+// or TimingStats, see skiplist_stats.hpp.
+template <typename TKey, typename TVal, typename ConcurrencyPolicy = SingleThreaded, typename Allocator = Arena,
+          typename Comparator = DefaultComparator<TKey>, size_t MaxHeight = 32,
+          typename Branching = BranchingHalf, typename Stats = NoStats>
+class BasicSkipList
+{
+    static_assert(MaxHeight > 0, "a skiplist needs at least one level");
+
+public:
+    static constexpr size_t MAX_HEIGHT = MaxHeight;
+
+private:
+    // One node per key, the next pointers of all levels the key is
+    // promoted to follow the node, so the value exists exactly once.
+    struct alignas(void *) Node
+    {
+        // the head is a node whose key and value are never constructed,
+        // it is recognized by its address
+        union
+        {
+            TKey k;
+        };
+        union
+        {
+            TVal v;
+        };
+
+        Node(const TKey &k, const TVal &v) : k(k), v(v) {}
+
+        Node() {}
+
+        ~Node()
+            requires std::is_trivially_destructible_v<TKey> && std::is_trivially_destructible_v<TVal>
+        = default;
+
+        // key and value are destroyed by the list, which knows the head
+        ~Node() {}
+
+        Node **nextArray()
+        {
+            return reinterpret_cast<Node **>(this + 1);
+        }
+
+        Node *next(size_t level) const
+        {
+            return reinterpret_cast<Node *const *>(this + 1)[level];
+        }
+
+        static size_t allocationSize(size_t height)
+        {
+            return sizeof(Node) + height * sizeof(Node *);
+        }
+    };
+
+    size_t height;
+    Allocator allocator;
+    Node *head;
+    [[no_unique_address]] mutable typename ConcurrencyPolicy::Mutex mutex;
+    [[no_unique_address]] Comparator compare;
+    TowerHeightGenerator<Branching> heightGenerator;
+
+    Node *allocateNode(size_t nodeHeight)
+    {
+        void *memory = allocator.allocate(Node::allocationSize(nodeHeight), alignof(Node), Node::allocationSize(1));
+        std::fill_n(reinterpret_cast<Node **>(static_cast<Node *>(memory) + 1), nodeHeight, nullptr);
+        return static_cast<Node *>(memory);
+    }
+
+    // Moves current along level to the last node before k and returns
+    // its successor.
+    Node *forward(Node *&current, size_t level, const TKey &k) const
+    {
+        Node *next = current->next(level);
+        while (next != nullptr)
+        {
+            Stats::compare();
+            if (!compare(next->k, k))
+            {
+                break;
+            }
+            Stats::visit(level);
+            current = next;
+            next = current->next(level);
+        }
+        return next;
+    }
+
+    // node is the first one not before k
+    bool matches(const Node *node, const TKey &k) const
+    {
+        return node != nullptr && !compare(k, node->k);
+    }
+
+public:
+    // allocatorArgs construct the allocator, such as an Arena block size
+    template <typename... AllocatorArgs>
+    BasicSkipList(size_t height, AllocatorArgs &&...allocatorArgs)
+        : height(height), allocator(std::forward<AllocatorArgs>(allocatorArgs)...)
+    {
+        if (height == 0 || height > MAX_HEIGHT)
+        {
+            throw std::invalid_argument("skiplist height must be between 1 and MAX_HEIGHT");
+        }
+        head = new (allocateNode(height)) Node();
+    }
+
+    BasicSkipList(const BasicSkipList &) = delete;
+    BasicSkipList &operator=(const BasicSkipList &) = delete;
+
+    ~BasicSkipList()
+    {
+        clear();
+    }
+
+    // Destroys all nodes, the list cannot be used afterwards. No find may
+    // run concurrently.
+    void clear()
+    {
+        if (head == nullptr)
+        {
+            return;
+        }
+        if constexpr (!std::is_trivially_destructible_v<Node>)
+        {
+            Node *current = head->next(0);
+            while (current != nullptr)
+            {
+                Node *next = current->next(0);
+                current->k.~TKey();
+                current->v.~TVal();
+                current->~Node();
+                current = next;
+            }
+            head->~Node();
+        }
+        head = nullptr;
+        allocator.release();
+    }
+
+    // Searches top down, remembering the last node before k on every level.
+    // An existing key is found on the highest level of its tower and its
+    // value updated with a single store, a new key is linked into the
+    // remembered predecessors.
+    void upsert(TKey k, TVal v)
+    {
+        [[maybe_unused]] auto timer = Stats::timeUpsert();
+        [[maybe_unused]] auto lock = ConcurrencyPolicy::lock(mutex);
+        Node *preds[MAX_HEIGHT];
+        Node *current = head;
+        for (size_t level = height; level-- > 0;)
+        {
+            Node *next = forward(current, level, k);
+            if (matches(next, k))
+            {
+                Stats::update();
+                next->v = v;
+                return;
+            }
+            preds[level] = current;
+        }
+
+        size_t nodeHeight = heightGenerator.next(height);
+        Stats::insert(nodeHeight);
+        Node *newNode = new (allocateNode(nodeHeight)) Node(k, v);
+        for (size_t level = 0; level < nodeHeight; level++)
+        {
+            newNode->nextArray()[level] = preds[level]->next(level);
+            preds[level]->nextArray()[level] = newNode;
+        }
+    }
+
+    std::optional<TVal> find(const TKey &k) const
+    {
+        [[maybe_unused]] auto timer = Stats::timeFind();
+        [[maybe_unused]] auto lock = ConcurrencyPolicy::lockShared(mutex);
+        Stats::find();
+        Node *current = head;
+        for (size_t level = height; level-- > 0;)
+        {
+            Node *next = forward(current, level, k);
+            if (matches(next, k))
+            {
+                return next->v;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // bytes reserved by the allocator
+    size_t memoryUsage() const
+    {
+        return allocator.memoryUsage();
+    }
+
+    // size of a node promoted to a single level
+    static size_t getNodeSize()
+    {
+        return Node::allocationSize(1);
+    }
+};
@@ -0,0 +1,554 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "arena.hpp"
+#include "epoch.hpp"
+#include "skiplist_random.hpp"
+#include "skiplist_stats.hpp"
+
+// Single writer, multiple reader skiplist of integer keys whose nodes hold
+// up to BlockKeys sorted keys instead of one. A node is ordered by its
+// first key and every level, not only the bottom one, links nodes, so a
+// horizontal step skips a whole block and the block is searched with one
+// vector compare per register of keys.
+//
+// Keys and count of a published node never change. The writer inserts a
+// key by building a copy of its node with the key added, splitting it into
+// two when it is full, and swapping the copy in with one release store per
+// level; readers positioned on the old node still see a consistent block
+// and find their way forward through its next pointers. Replaced nodes are
+// reclaimed through epochs like erased nodes of SkipListAtomicSingleWriter.
+// Values of existing keys are updated in place.
+//
+// Stats is NoStats, CountingStats or TimingStats, see skiplist_stats.hpp.
+// An insert is counted with the height of the node taking the key, a block
+// search counts as one comparison.
+template <typename TKey, typename TVal, size_t BlockKeys = 16, typename Branching = BranchingHalf,
+          typename Stats = NoStats>
+    requires std::is_integral_v<TKey> && std::is_trivially_copyable_v<TVal>
+class SkipListFatNode
+{
+    static_assert(BlockKeys >= 2 && BlockKeys <= 64, "blocks hold between 2 and 64 keys");
+
+public:
+    static constexpr size_t MAX_HEIGHT = 32;
+    // retired nodes that trigger an attempt to reclaim them
+    static constexpr size_t RECLAIM_THRESHOLD = 64;
+
+private:
+    using Mask = uint64_t;
+
+    struct alignas(32) Node
+    {
+        uint32_t count;
+        uint32_t height;
+        // sorted, only the first count are used, the rest stay zero so a
+        // vector compare over the whole block reads initialized memory
+        alignas(32) TKey keys[BlockKeys] = {};
+        std::atomic<TVal> values[BlockKeys];
+
+        Node(uint32_t count, uint32_t height) : count(count), height(height) {}
+
+        std::atomic<Node *> *nextArray()
+        {
+            return reinterpret_cast<std::atomic<Node *> *>(this + 1);
+        }
+
+        const std::atomic<Node *> *nextArray() const
+        {
+            return reinterpret_cast<const std::atomic<Node *> *>(this + 1);
+        }
+
+        Node *next(size_t level) const
+        {
+            return nextArray()[level].load(std::memory_order_acquire);
+        }
+
+        const TKey &first() const
+        {
+            return keys[0];
+        }
+
+        static size_t allocationSize(size_t height)
+        {
+            return sizeof(Node) + height * sizeof(std::atomic<Node *>);
+        }
+    };
+
+    size_t maxHeight;
+    std::atomic<size_t> activeHeight{1};
+    Arena arena;
+    Node *head;
+    TowerHeightGenerator<Branching> heightGenerator;
+    mutable EpochManager epochs;
+    size_t reclaimAt = RECLAIM_THRESHOLD;
+
+    Node *allocateNode(uint32_t count, size_t nodeHeight)
+    {
+        void *memory = arena.allocate(Node::allocationSize(nodeHeight), alignof(Node));
+        Node *node = new (memory) Node(count, static_cast<uint32_t>(nodeHeight));
+        for (size_t i = 0; i < nodeHeight; i++)
+        {
+            new (&node->nextArray()[i]) std::atomic<Node *>(nullptr);
+        }
+        return node;
+    }
+
+    void retire(Node *node)
+    {
+        epochs.retire(node, Node::allocationSize(node->height));
+        if (epochs.pending() >= reclaimAt)
+        {
+            epochs.reclaim([this](void *memory, size_t bytes) { arena.deallocate(memory, bytes); });
+            reclaimAt = std::max(RECLAIM_THRESHOLD, 2 * epochs.pending());
+        }
+    }
+
+    // bit i set if keys[i] == k, for the first count keys
+    static Mask equalMask(const Node *node, const TKey &k)
+    {
+        Mask mask = 0;
+#if defined(__AVX2__)
+        if constexpr (sizeof(TKey) == 4 && BlockKeys % 8 == 0)
+        {
+            __m256i needle = _mm256_set1_epi32(static_cast<int32_t>(k));
+            for (size_t i = 0; i < BlockKeys; i += 8)
+            {
+                __m256i block = _mm256_load_si256(reinterpret_cast<const __m256i *>(node->keys + i));
+                __m256i equal = _mm256_cmpeq_epi32(block, needle);
+                auto bits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(equal)));
+                mask |= static_cast<Mask>(bits) << i;
+            }
+            return mask & lowBits(node->count);
+        }
+        else if constexpr (sizeof(TKey) == 8 && BlockKeys % 4 == 0)
+        {
+            __m256i needle = _mm256_set1_epi64x(static_cast<int64_t>(k));
+            for (size_t i = 0; i < BlockKeys; i += 4)
+            {
+                __m256i block = _mm256_load_si256(reinterpret_cast<const __m256i *>(node->keys + i));
+                __m256i equal = _mm256_cmpeq_epi64(block, needle);
+                auto bits = static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(equal)));
+                mask |= static_cast<Mask>(bits) << i;
+            }
+            return mask & lowBits(node->count);
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        if constexpr (sizeof(TKey) == 4 && BlockKeys % 4 == 0)
+        {
+            uint32x4_t needle = vdupq_n_u32(static_cast<uint32_t>(k));
+            for (size_t i = 0; i < BlockKeys; i += 4)
+            {
+                uint32x4_t block = vld1q_u32(reinterpret_cast<const uint32_t *>(node->keys + i));
+                // one bit per lane, weighted by its position
+                const uint32x4_t weights = {1, 2, 4, 8};
+                uint32_t bits = vaddvq_u32(vandq_u32(vceqq_u32(block, needle), weights));
+                mask |= static_cast<Mask>(bits) << i;
+            }
+            return mask & lowBits(node->count);
+        }
+#endif
+        // plain loop over the whole block, which compilers vectorize
+        for (size_t i = 0; i < BlockKeys; i++)
+        {
+            mask |= static_cast<Mask>(node->keys[i] == k) << i;
+        }
+        return mask & lowBits(node->count);
+    }
+
+    static Mask lowBits(uint32_t count)
+    {
+        return count >= 64 ? ~Mask(0) : (Mask(1) << count) - 1;
+    }
+
+    // number of keys in the node less than k, where k would be inserted
+    static size_t rank(const Node *node, const TKey &k)
+    {
+        size_t less = 0;
+        for (size_t i = 0; i < node->count; i++)
+        {
+            less += node->keys[i] < k;
+        }
+        return less;
+    }
+
+    // last node whose first key is not greater than k, the head if none
+    Node *findNode(const TKey &k) const
+    {
+        Node *current = head;
+        for (size_t level = activeHeight.load(std::memory_order_relaxed); level-- > 0;)
+        {
+            Node *next = current->next(level);
+            while (next != nullptr)
+            {
+                Stats::compare();
+                if (k < next->first())
+                {
+                    break;
+                }
+                Stats::visit(level);
+                current = next;
+                next = current->next(level);
+            }
+        }
+        return current;
+    }
+
+    // preds[level] is the last node with a first key less than k
+    void findPredecessors(const TKey &k, Node **preds) const
+    {
+        Node *current = head;
+        for (size_t level = activeHeight.load(std::memory_order_relaxed); level-- > 0;)
+        {
+            Node *next = current->next(level);
+            while (next != nullptr)
+            {
+                Stats::compare();
+                if (!(next->first() < k))
+                {
+                    break;
+                }
+                Stats::visit(level);
+                current = next;
+                next = current->next(level);
+            }
+            preds[level] = current;
+        }
+    }
+
+    // node's entries with k inserted at position
+    struct Merged
+    {
+        TKey keys[BlockKeys + 1];
+        TVal values[BlockKeys + 1];
+        size_t count;
+
+        Merged(const Node *node, size_t position, const TKey &k, const TVal &v) : count(node->count + 1)
+        {
+            for (size_t i = 0, from = 0; i < count; i++)
+            {
+                if (i == position)
+                {
+                    keys[i] = k;
+                    values[i] = v;
+                    continue;
+                }
+                keys[i] = node->keys[from];
+                values[i] = node->values[from].load(std::memory_order_relaxed);
+                from++;
+            }
+        }
+    };
+
+    // new node with the merged entries in [begin, end)
+    Node *buildNode(const Merged &merged, size_t begin, size_t end, size_t nodeHeight)
+    {
+        Node *node = allocateNode(static_cast<uint32_t>(end - begin), nodeHeight);
+        for (size_t i = begin; i < end; i++)
+        {
+            node->keys[i - begin] = merged.keys[i];
+            node->values[i - begin].store(merged.values[i], std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    void raiseHeight(size_t nodeHeight, Node **preds)
+    {
+        size_t currentHeight = activeHeight.load(std::memory_order_relaxed);
+        for (size_t level = currentHeight; level < nodeHeight; level++)
+        {
+            preds[level] = head;
+        }
+        if (nodeHeight > currentHeight)
+        {
+            activeHeight.store(nodeHeight, std::memory_order_relaxed);
+        }
+    }
+
+    // Links the fully built replacement nodes, then makes them reachable
+    // level by level; a reader sees either node or its replacement.
+    void replace(Node *node, Node *left, Node *right, Node **preds)
+    {
+        size_t leftHeight = left->height;
+        size_t rightHeight = right != nullptr ? right->height : 0;
+        size_t oldHeight = node != nullptr ? node->height : 0;
+        raiseHeight(std::max(leftHeight, rightHeight), preds);
+
+        for (size_t level = 0; level < std::max({leftHeight, rightHeight, oldHeight}); level++)
+        {
+            // the first node after the replaced ones on this level
+            Node *after = level < oldHeight ? node->next(level) : preds[level]->next(level);
+            if (right != nullptr && level < rightHeight)
+            {
+                right->nextArray()[level].store(after, std::memory_order_relaxed);
+                after = right;
+            }
+            if (level < leftHeight)
+            {
+                left->nextArray()[level].store(after, std::memory_order_relaxed);
+                after = left;
+            }
+            preds[level]->nextArray()[level].store(after, std::memory_order_release);
+        }
+        if (node != nullptr)
+        {
+            retire(node);
+        }
+    }
+
+public:
+    SkipListFatNode(size_t height, size_t arenaBlockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : SkipListFatNode(height, ArenaOptions{.blockSize = arenaBlockSize})
+    {
+    }
+
+    // arenaOptions choose block size and NUMA node of the node memory
+    SkipListFatNode(size_t height, const ArenaOptions &arenaOptions)
+        : maxHeight(height), arena(arenaOptions)
+    {
+        if (maxHeight == 0 || maxHeight > MAX_HEIGHT)
+        {
+            throw std::invalid_argument("skiplist height must be between 1 and MAX_HEIGHT");
+        }
+        head = allocateNode(0, maxHeight);
+    }
+
+    SkipListFatNode(const SkipListFatNode &) = delete;
+    SkipListFatNode &operator=(const SkipListFatNode &) = delete;
+
+    // maximum height that keeps searches logarithmic for up to expectedKeys
+    // keys, with blocks about three quarters full
+    static size_t heightForCapacity(size_t expectedKeys)
+    {
+        size_t nodes = expectedKeys / (BlockKeys * 3 / 4);
+        double levels = std::ceil(std::log(static_cast<double>(nodes < 2 ? 2 : nodes)) /
+                                  -std::log(TowerHeightGenerator<Branching>::probability()));
+        size_t result = static_cast<size_t>(levels) + 1;
+        return result < MAX_HEIGHT ? result : MAX_HEIGHT;
+    }
+
+    void upsert(TKey k, TVal v)
+    {
+        [[maybe_unused]] auto timer = Stats::timeUpsert();
+        Node *preds[MAX_HEIGHT];
+        findPredecessors(k, preds);
+        Node *next = preds[0]->next(0);
+        if (next != nullptr && next->first() == k)
+        {
+            Stats::update();
+            next->values[0].store(v, std::memory_order_relaxed);
+            return;
+        }
+
+        // the node k belongs to: the one before it, or the first node for
+        // a key smaller than all
+        Node *node = preds[0] != head ? preds[0] : next;
+        if (node == nullptr)
+        {
+            Node *single = allocateNode(1, heightGenerator.next(maxHeight));
+            single->keys[0] = k;
+            single->values[0].store(v, std::memory_order_relaxed);
+            Stats::insert(single->height);
+            replace(nullptr, single, nullptr, preds);
+            return;
+        }
+        Stats::compare();
+        if (Mask found = equalMask(node, k))
+        {
+            Stats::update();
+            node->values[std::countr_zero(found)].store(v, std::memory_order_relaxed);
+            return;
+        }
+
+        if (node != next)
+        {
+            // the predecessors of node itself, not of k
+            findPredecessors(node->first(), preds);
+        }
+        size_t position = rank(node, k);
+        Merged merged(node, position, k, v);
+        if (merged.count <= BlockKeys)
+        {
+            Stats::insert(node->height);
+            replace(node, buildNode(merged, 0, merged.count, node->height), nullptr, preds);
+            return;
+        }
+
+        // split in halves, the left one keeps the tower of the full node
+        size_t half = merged.count / 2;
+        Node *left = buildNode(merged, 0, half, node->height);
+        Node *right = buildNode(merged, half, merged.count, heightGenerator.next(maxHeight));
+        Stats::insert(position < half ? left->height : right->height);
+        replace(node, left, right, preds);
+    }
+
+    // Upserts a range of (key, value) pairs in order.
+    template <typename It>
+    void upsertBatch(It begin, It end)
+    {
+        for (; begin != end; ++begin)
+        {
+            upsert(std::get<0>(*begin), std::get<1>(*begin));
+        }
+    }
+
+    std::optional<TVal> find(const TKey &k) const
+    {
+        [[maybe_unused]] auto timer = Stats::timeFind();
+        auto guard = epochs.pin();
+        Stats::find();
+        Node *node = findNode(k);
+        if (node == head)
+        {
+            return std::nullopt;
+        }
+        Stats::compare();
+        if (Mask found = equalMask(node, k))
+        {
+            return node->values[std::countr_zero(found)].load(std::memory_order_relaxed);
+        }
+        return std::nullopt;
+    }
+
+    // Forward iterator over all keys in order. Pins an epoch, so it stays
+    // valid while the writer goes on; it must be destroyed by the thread
+    // that created it.
+    class Iterator
+    {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<TKey, TVal>;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+
+        Iterator() = default;
+
+        const TKey &key() const
+        {
+            return node->keys[index];
+        }
+
+        TVal value() const
+        {
+            return node->values[index].load(std::memory_order_relaxed);
+        }
+
+        value_type operator*() const
+        {
+            return {key(), value()};
+        }
+
+        Iterator &operator++()
+        {
+            if (++index == node->count)
+            {
+                node = node->next(0);
+                index = 0;
+            }
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator &other) const
+        {
+            return node == other.node && index == other.index;
+        }
+
+        bool operator!=(const Iterator &other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        friend class SkipListFatNode;
+
+        Iterator(const Node *node, size_t index, EpochManager::Guard guard)
+            : node(node), index(index), guard(std::move(guard))
+        {
+            if (this->node != nullptr && this->index == this->node->count)
+            {
+                this->node = this->node->next(0);
+                this->index = 0;
+            }
+        }
+
+        const Node *node = nullptr;
+        size_t index = 0;
+        EpochManager::Guard guard;
+    };
+
+    Iterator begin() const
+    {
+        auto guard = epochs.pin();
+        return Iterator(head->next(0), 0, std::move(guard));
+    }
+
+    Iterator end() const
+    {
+        return Iterator();
+    }
+
+    // iterator to the first key not less than k
+    Iterator seek(const TKey &k) const
+    {
+        auto guard = epochs.pin();
+        Node *node = findNode(k);
+        if (node == head)
+        {
+            return Iterator(head->next(0), 0, std::move(guard));
+        }
+        return Iterator(node, rank(node, k), std::move(guard));
+    }
+
+    // Calls callback(key, value) for every key in [from, to) in order.
+    template <typename Callback>
+    void scan(const TKey &from, const TKey &to, Callback &&callback) const
+    {
+        for (Iterator it = seek(from); it != end() && it.key() < to; ++it)
+        {
+            callback(it.key(), it.value());
+        }
+    }
+
+    // number of levels currently in use
+    size_t getHeight() const
+    {
+        return activeHeight.load(std::memory_order_relaxed);
+    }
+
+    // size of a node promoted to a single level, it holds up to BlockKeys
+    static size_t getNodeSize()
+    {
+        return Node::allocationSize(1);
+    }
+
+    // Bytes reserved by the node arena. Safe to call from any thread.
+    size_t memoryUsage() const
+    {
+        return arena.memoryUsage();
+    }
+};
@@ -0,0 +1,667 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "skiplist_keys.hpp"
+
+// Sorted file written by SkipListAtomicSingleWriter::flush() and read by
+// MappedSkipList. Records are stored back to back in key order, each a
+// varint key size, a varint value size and the raw bytes of both. They are
+// grouped in blocks of about blockSize bytes, a sparse index records the
+// first key and offset of every block:
+//
+//   [block 0] ... [block n-1]
+//   [index entry 0] ... [index entry n-1]   varint key size, key, offset
+//   [entry offsets]                         uint64 per index entry
+//   [footer]
+//
+// Integers are in host byte order, the magic number tells a file written
+// on a machine of the other byte order apart from a corrupt one.
+
+// How keys and values are laid out in a sorted file. Trivially copyable
+// types are stored as their bytes, string types as their characters.
+// Decoding a string gives a view into the file.
+template <typename T>
+struct FileCodec;
+
+template <typename T>
+    requires std::is_trivially_copyable_v<T>
+struct FileCodec<T>
+{
+    using View = T;
+
+    static std::string_view bytes(const T &v)
+    {
+        return {reinterpret_cast<const char *>(&v), sizeof(T)};
+    }
+
+    static View decode(const char *data, size_t size)
+    {
+        if (size != sizeof(T))
+        {
+            throw std::runtime_error("sorted file field has the wrong size");
+        }
+        T result;
+        std::memcpy(&result, data, sizeof(T));
+        return result;
+    }
+};
+
+template <>
+struct FileCodec<std::string_view>
+{
+    using View = std::string_view;
+
+    static std::string_view bytes(std::string_view v)
+    {
+        return v;
+    }
+
+    static View decode(const char *data, size_t size)
+    {
+        return {data, size};
+    }
+};
+
+template <>
+struct FileCodec<std::string> : FileCodec<std::string_view>
+{
+};
+
+template <typename T>
+concept FileEncodable = requires { typename FileCodec<T>::View; };
+
+struct SortedFileOptions
+{
+    // the index has one entry per block
+    size_t blockSize = 4096;
+    // bytes collected before each write
+    size_t bufferSize = 1 << 20;
+    // bypass the page cache with O_DIRECT, falls back to buffered writes
+    // where the file system does not support it
+    bool directIO = false;
+};
+
+namespace sorted_file
+{
+    constexpr uint64_t MAGIC = 0x53'4b'49'50'46'49'4c'45; // "SKIPFILE"
+    constexpr uint32_t VERSION = 1;
+    constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+    struct Footer
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t records;
+        uint64_t indexOffset;
+        uint64_t offsetsOffset;
+        uint64_t indexEntries;
+    };
+
+    inline size_t putVarint(char *out, uint64_t value)
+    {
+        size_t length = 0;
+        while (value >= 0x80)
+        {
+            out[length++] = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        out[length++] = static_cast<char>(value);
+        return length;
+    }
+
+    // Returns the position after the varint, nullptr if it runs past end.
+    inline const char *getVarint(const char *in, const char *end, uint64_t &value)
+    {
+        value = 0;
+        for (unsigned shift = 0; shift < 64 && in < end; shift += 7)
+        {
+            auto byte = static_cast<unsigned char>(*in++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (byte < 0x80)
+            {
+                return in;
+            }
+        }
+        return nullptr;
+    }
+
+    [[noreturn]] inline void throwErrno(const std::string &what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+}
+
+// Streams records given in key order into a sorted file. The file is
+// written under a temporary name and renamed into place by finish(), so a
+// reader never sees a partial file; without finish() it is removed again.
+template <FileEncodable TKey, FileEncodable TVal>
+class SortedFileWriter
+{
+private:
+    std::string path;
+    std::string temporaryPath;
+    SortedFileOptions options;
+    int fd = -1;
+    bool direct = false;
+
+    std::unique_ptr<char, decltype(&std::free)> buffer{nullptr, &std::free};
+    size_t buffered = 0;
+    uint64_t written = 0;
+
+    uint64_t records = 0;
+    uint64_t blockStart = 0;
+    std::vector<std::pair<std::string, uint64_t>> index;
+
+    void writeAll(const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t result = ::write(fd, data, size);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                sorted_file::throwErrno("write " + temporaryPath);
+            }
+            data += result;
+            size -= static_cast<size_t>(result);
+        }
+    }
+
+    void append(const char *data, size_t size)
+    {
+        written += size;
+        while (size > 0)
+        {
+            size_t chunk = std::min(size, options.bufferSize - buffered);
+            std::memcpy(buffer.get() + buffered, data, chunk);
+            buffered += chunk;
+            data += chunk;
+            size -= chunk;
+            if (buffered == options.bufferSize)
+            {
+                writeAll(buffer.get(), buffered);
+                buffered = 0;
+            }
+        }
+    }
+
+    void appendField(std::string_view bytes)
+    {
+        char header[10];
+        append(header, sorted_file::putVarint(header, bytes.size()));
+        append(bytes.data(), bytes.size());
+    }
+
+    template <typename T>
+    void appendValue(const T &value)
+    {
+        append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    // O_DIRECT writes whole aligned blocks, the zero padding of the last
+    // one is cut off again
+    void drain()
+    {
+        if (direct)
+        {
+            size_t padded = (buffered + sorted_file::DIRECT_ALIGNMENT - 1) / sorted_file::DIRECT_ALIGNMENT *
+                            sorted_file::DIRECT_ALIGNMENT;
+            std::memset(buffer.get() + buffered, 0, padded - buffered);
+            writeAll(buffer.get(), padded);
+            if (::ftruncate(fd, static_cast<off_t>(written)) != 0)
+            {
+                sorted_file::throwErrno("truncate " + temporaryPath);
+            }
+        }
+        else
+        {
+            writeAll(buffer.get(), buffered);
+        }
+        buffered = 0;
+    }
+
+    void closeFile()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+public:
+    explicit SortedFileWriter(std::string path, SortedFileOptions options = {})
+        : path(std::move(path)), temporaryPath(this->path + ".tmp"), options(options)
+    {
+        if (options.blockSize == 0)
+        {
+            throw std::invalid_argument("sorted file block size must not be 0");
+        }
+        // direct writes need a buffer of whole aligned blocks
+        size_t alignment = sorted_file::DIRECT_ALIGNMENT;
+        this->options.bufferSize = std::max((options.bufferSize + alignment - 1) / alignment * alignment, alignment);
+        buffer.reset(static_cast<char *>(std::aligned_alloc(alignment, this->options.bufferSize)));
+        if (!buffer)
+        {
+            throw std::bad_alloc();
+        }
+
+        int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+        if (options.directIO)
+        {
+            fd = ::open(temporaryPath.c_str(), flags | O_DIRECT, 0644);
+            direct = fd >= 0;
+        }
+#endif
+        if (fd < 0)
+        {
+            fd = ::open(temporaryPath.c_str(), flags, 0644);
+        }
+        if (fd < 0)
+        {
+            sorted_file::throwErrno("open " + temporaryPath);
+        }
+    }
+
+    SortedFileWriter(const SortedFileWriter &) = delete;
+    SortedFileWriter &operator=(const SortedFileWriter &) = delete;
+
+    ~SortedFileWriter()
+    {
+        if (fd >= 0)
+        {
+            closeFile();
+            ::unlink(temporaryPath.c_str());
+        }
+    }
+
+    // keys must come in ascending order
+    void add(const TKey &k, const TVal &v)
+    {
+        std::string_view key = FileCodec<TKey>::bytes(k);
+        if (records == 0 || written - blockStart >= options.blockSize)
+        {
+            blockStart = written;
+            index.emplace_back(key, blockStart);
+        }
+        appendField(key);
+        appendField(FileCodec<TVal>::bytes(v));
+        records++;
+    }
+
+    // Writes index and footer, syncs the file and moves it into place.
+    // Returns the number of records.
+    uint64_t finish()
+    {
+        sorted_file::Footer footer{};
+        footer.magic = sorted_file::MAGIC;
+        footer.version = sorted_file::VERSION;
+        footer.records = records;
+        footer.indexOffset = written;
+        footer.indexEntries = index.size();
+
+        std::vector<uint64_t> entryOffsets;
+        entryOffsets.reserve(index.size());
+        for (const auto &[key, offset] : index)
+        {
+            entryOffsets.push_back(written);
+            appendField(key);
+            appendValue(offset);
+        }
+        footer.offsetsOffset = written;
+        for (uint64_t offset : entryOffsets)
+        {
+            appendValue(offset);
+        }
+        appendValue(footer);
+        drain();
+
+        if (::fsync(fd) != 0)
+        {
+            sorted_file::throwErrno("fsync " + temporaryPath);
+        }
+        closeFile();
+        if (::rename(temporaryPath.c_str(), path.c_str()) != 0)
+        {
+            int error = errno;
+            ::unlink(temporaryPath.c_str());
+            throw std::system_error(error, std::generic_category(), "rename " + temporaryPath);
+        }
+        return records;
+    }
+};
+
+// Read-only list over a sorted file, mapped into memory. Lookups binary
+// search the sparse index and scan one block, records are decoded in
+// place: string keys and values are views into the mapping and stay valid
+// as long as the list. Safe to use from any number of threads.
+//
+// Comparator must order keys like the list that wrote the file. Lists of
+// std::string keys or values are read back with std::string_view.
+template <FileEncodable TKey, FileEncodable TVal, typename Comparator = DefaultComparator<TKey>>
+class MappedSkipList
+{
+public:
+    using Key = typename FileCodec<TKey>::View;
+    using Value = typename FileCodec<TVal>::View;
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    sorted_file::Footer footer{};
+    [[no_unique_address]] Comparator compare;
+
+    struct Record
+    {
+        Key k;
+        Value v;
+        // start of the following record
+        const char *next;
+    };
+
+    const char *dataEnd() const
+    {
+        return data + footer.indexOffset;
+    }
+
+    [[noreturn]] static void corrupt()
+    {
+        throw std::runtime_error("sorted file is corrupt");
+    }
+
+    // reads a varint size and that many bytes, end bounds the region
+    static const char *readField(const char *in, const char *end, const char *&field, size_t &fieldSize)
+    {
+        uint64_t length = 0;
+        in = sorted_file::getVarint(in, end, length);
+        if (in == nullptr || length > static_cast<uint64_t>(end - in))
+        {
+            corrupt();
+        }
+        field = in;
+        fieldSize = static_cast<size_t>(length);
+        return in + length;
+    }
+
+    Record readRecord(const char *in) const
+    {
+        const char *key;
+        const char *value;
+        size_t keySize;
+        size_t valueSize;
+        in = readField(in, dataEnd(), key, keySize);
+        in = readField(in, dataEnd(), value, valueSize);
+        return {FileCodec<TKey>::decode(key, keySize), FileCodec<TVal>::decode(value, valueSize), in};
+    }
+
+    struct IndexEntry
+    {
+        Key k;
+        const char *block;
+    };
+
+    IndexEntry indexEntry(size_t i) const
+    {
+        uint64_t entryOffset;
+        std::memcpy(&entryOffset, data + footer.offsetsOffset + i * sizeof(uint64_t), sizeof(entryOffset));
+        if (entryOffset < footer.indexOffset || entryOffset >= footer.offsetsOffset)
+        {
+            corrupt();
+        }
+        const char *key;
+        size_t keySize;
+        const char *end = data + footer.offsetsOffset;
+        const char *in = readField(data + entryOffset, end, key, keySize);
+        uint64_t blockOffset;
+        if (static_cast<size_t>(end - in) < sizeof(blockOffset))
+        {
+            corrupt();
+        }
+        std::memcpy(&blockOffset, in, sizeof(blockOffset));
+        if (blockOffset >= footer.indexOffset)
+        {
+            corrupt();
+        }
+        return {FileCodec<TKey>::decode(key, keySize), data + blockOffset};
+    }
+
+    // first record with a key not less than k, dataEnd() if there is none
+    const char *lowerBound(const Key &k) const
+    {
+        // last block whose first key is less than k, the block before it
+        // ends with a key less than k as well
+        size_t low = 0;
+        size_t high = footer.indexEntries;
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            if (compare(indexEntry(middle).k, k))
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        if (low == 0)
+        {
+            return data;
+        }
+
+        const char *current = indexEntry(low - 1).block;
+        while (current < dataEnd())
+        {
+            Record record = readRecord(current);
+            if (!compare(record.k, k))
+            {
+                return current;
+            }
+            current = record.next;
+        }
+        return current;
+    }
+
+public:
+    explicit MappedSkipList(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            sorted_file::throwErrno("open " + path);
+        }
+        struct stat status;
+        if (::fstat(fd, &status) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "stat " + path);
+        }
+        size = static_cast<size_t>(status.st_size);
+        if (size < sizeof(footer))
+        {
+            ::close(fd);
+            corrupt();
+        }
+        void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            throw std::system_error(error, std::generic_category(), "mmap " + path);
+        }
+        data = static_cast<const char *>(mapping);
+
+        std::memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+        uint64_t footerOffset = size - sizeof(footer);
+        if (footer.magic != sorted_file::MAGIC || footer.version != sorted_file::VERSION ||
+            footer.indexOffset > footer.offsetsOffset || footer.offsetsOffset > footerOffset ||
+            (footerOffset - footer.offsetsOffset) / sizeof(uint64_t) != footer.indexEntries ||
+            (footer.indexEntries == 0) != (footer.records == 0))
+        {
+            ::munmap(mapping, size);
+            corrupt();
+        }
+    }
+
+    MappedSkipList(const MappedSkipList &) = delete;
+    MappedSkipList &operator=(const MappedSkipList &) = delete;
+
+    ~MappedSkipList()
+    {
+        ::munmap(const_cast<char *>(data), size);
+    }
+
+    // Forward iterator over the records in key order.
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<Key, Value>;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+
+        Iterator() = default;
+
+        const Key &key() const
+        {
+            return record.k;
+        }
+
+        const Value &value() const
+        {
+            return record.v;
+        }
+
+        value_type operator*() const
+        {
+            return {record.k, record.v};
+        }
+
+        Iterator &operator++()
+        {
+            position = record.next;
+            load();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        // iterators past the last record compare equal
+        bool operator==(const Iterator &other) const
+        {
+            return position == other.position;
+        }
+
+    private:
+        friend class MappedSkipList;
+
+        const MappedSkipList *list = nullptr;
+        const char *position = nullptr;
+        Record record{};
+
+        Iterator(const MappedSkipList &list, const char *position) : list(&list), position(position)
+        {
+            load();
+        }
+
+        void load()
+        {
+            if (position < list->dataEnd())
+            {
+                record = list->readRecord(position);
+            }
+            else
+            {
+                position = nullptr;
+            }
+        }
+    };
+
+    std::optional<Value> find(const Key &k) const
+    {
+        const char *position = lowerBound(k);
+        if (position == dataEnd())
+        {
+            return std::nullopt;
+        }
+        Record record = readRecord(position);
+        if (compare(k, record.k))
+        {
+            return std::nullopt;
+        }
+        return record.v;
+    }
+
+    Iterator begin() const
+    {
+        return Iterator(*this, data);
+    }
+
+    Iterator end() const
+    {
+        return Iterator();
+    }
+
+    // iterator to the first key not less than k
+    Iterator seek(const Key &k) const
+    {
+        return Iterator(*this, lowerBound(k));
+    }
+
+    // Calls callback(key, value) for every key in [from, to) in order.
+    template <typename Callback>
+    void scan(const Key &from, const Key &to, Callback &&callback) const
+    {
+        for (Iterator it = seek(from); it != end() && compare(it.key(), to); ++it)
+        {
+            callback(it.key(), it.value());
+        }
+    }
+
+    size_t records() const
+    {
+        return static_cast<size_t>(footer.records);
+    }
+
+    size_t blocks() const
+    {
+        return static_cast<size_t>(footer.indexEntries);
+    }
+
+    // bytes of the mapped file
+    size_t fileSize() const
+    {
+        return size;
+    }
+};
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "arena.hpp"
+
+// Orders keys lexicographically by their unsigned bytes, like memcmp, and
+// exposes the first 8 bytes as a big endian integer. Lists keep that prefix
+// in every node, so comparing two prefixes orders most keys without
+// touching the key bytes, only keys sharing a prefix are compared in full.
+struct BytewiseComparator
+{
+    // char_traits<char> compares as unsigned char
+    bool operator()(std::string_view a, std::string_view b) const
+    {
+        return a.compare(b) < 0;
+    }
+
+    // keys shorter than 8 bytes are padded with zeros, so equal prefixes
+    // only mean the full keys have to be compared
+    static uint64_t prefix(std::string_view key)
+    {
+        unsigned char bytes[8] = {};
+        // an empty view may have no data at all, memcpy must not see it
+        if (!key.empty())
+        {
+            std::memcpy(bytes, key.data(), key.size() < sizeof(bytes) ? key.size() : sizeof(bytes));
+        }
+        uint64_t result = 0;
+        for (unsigned char byte : bytes)
+        {
+            result = result << 8 | byte;
+        }
+        return result;
+    }
+};
+
+template <typename TKey>
+struct DefaultComparator
+{
+    bool operator()(const TKey &a, const TKey &b) const
+    {
+        return a < b;
+    }
+};
+
+template <>
+struct DefaultComparator<std::string_view> : BytewiseComparator
+{
+};
+
+template <>
+struct DefaultComparator<std::string> : BytewiseComparator
+{
+};
+
+// A comparator may provide a static prefix(key) returning an integer whose
+// order agrees with the comparator: prefix(a) < prefix(b) implies a < b.
+template <typename Comparator, typename TKey>
+concept PrefixComparator = requires(const TKey &k) {
+    { Comparator::prefix(k) } -> std::same_as<uint64_t>;
+};
+
+// How a key is stored in a node. Keys viewing memory owned by the caller
+// are copied behind the node, the stored key views that copy.
+template <typename TKey>
+struct KeyStorage
+{
+    static size_t payloadSize(const TKey &)
+    {
+        return 0;
+    }
+
+    static const TKey &store(const TKey &k, char *)
+    {
+        return k;
+    }
+};
+
+template <>
+struct KeyStorage<std::string_view>
+{
+    static size_t payloadSize(std::string_view k)
+    {
+        return k.size();
+    }
+
+    static std::string_view store(std::string_view k, char *payload)
+    {
+        if (!k.empty())
+        {
+            std::memcpy(payload, k.data(), k.size());
+        }
+        return {payload, k.size()};
+    }
+};
+
+// Arena memory referenced by a ValueSlot, empty if the value is stored in
+// the slot itself.
+struct SlotRecord
+{
+    void *memory = nullptr;
+    size_t bytes = 0;
+};
+
+// Holds the value of a node so that the writer can replace it while
+// readers load it. Trivially copyable values are kept in a std::atomic.
+template <typename TVal>
+class ValueSlot
+{
+private:
+    std::atomic<TVal> value;
+
+public:
+    ValueSlot() = default;
+
+    ValueSlot(const TVal &v, Arena &)
+    {
+        value.store(v, std::memory_order_relaxed);
+    }
+
+    TVal load() const
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    // returns the record the previous value occupied
+    SlotRecord store(const TVal &v, Arena &)
+    {
+        value.store(v, std::memory_order_relaxed);
+        return {};
+    }
+
+    SlotRecord record() const
+    {
+        return {};
+    }
+};
+
+// Trivially copyable values too large for a lock-free std::atomic sit
+// behind a sequence lock. The writer makes the sequence odd, copies the
+// value in and makes it even again; a reader copies the value out and
+// retries until it saw the same even sequence before and after. Reads
+// never block the writer, a long struct costs a retry at worst.
+//
+// The value is kept as relaxed atomic words, so the copies racing with
+// the writer are not data races; compilers still emit plain moves.
+template <typename TVal>
+    requires(std::is_trivially_copyable_v<TVal> && !std::atomic<TVal>::is_always_lock_free)
+class ValueSlot<TVal>
+{
+private:
+    static constexpr size_t WORDS = (sizeof(TVal) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> words[WORDS];
+
+    void write(const TVal &v)
+    {
+        uint64_t buffer[WORDS] = {};
+        std::memcpy(buffer, &v, sizeof(TVal));
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+    }
+
+public:
+    ValueSlot() = default;
+
+    ValueSlot(const TVal &v, Arena &)
+    {
+        write(v);
+    }
+
+    TVal load() const
+    {
+        uint64_t buffer[WORDS];
+        while (true)
+        {
+            uint64_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue;
+            }
+            for (size_t i = 0; i < WORDS; i++)
+            {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+            {
+                break;
+            }
+        }
+        TVal v;
+        std::memcpy(&v, buffer, sizeof(TVal));
+        return v;
+    }
+
+    // single writer only
+    SlotRecord store(const TVal &v, Arena &)
+    {
+        uint64_t next = sequence.load(std::memory_order_relaxed);
+        sequence.store(next + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        write(v);
+        sequence.store(next + 2, std::memory_order_release);
+        return {};
+    }
+
+    SlotRecord record() const
+    {
+        return {};
+    }
+};
+
+// Byte string values live in length prefixed records in the arena. Every
+// update writes a new record and swaps the pointer, so readers never see a
+// partially written value. The replaced record is handed back to the list,
+// which frees it once no reader can hold a view of it.
+template <>
+class ValueSlot<std::string_view>
+{
+private:
+    std::atomic<const char *> current{nullptr};
+
+    static const char *write(std::string_view v, Arena &arena)
+    {
+        size_t size = v.size();
+        auto *memory = static_cast<char *>(arena.allocate(sizeof(size) + size, alignof(size_t)));
+        std::memcpy(memory, &size, sizeof(size));
+        if (size > 0)
+        {
+            std::memcpy(memory + sizeof(size), v.data(), size);
+        }
+        return memory;
+    }
+
+    static SlotRecord recordOf(const char *memory)
+    {
+        size_t size;
+        std::memcpy(&size, memory, sizeof(size));
+        return {const_cast<char *>(memory), sizeof(size) + size};
+    }
+
+public:
+    ValueSlot() = default;
+
+    ValueSlot(std::string_view v, Arena &arena)
+    {
+        current.store(write(v, arena), std::memory_order_relaxed);
+    }
+
+    std::string_view load() const
+    {
+        const char *memory = current.load(std::memory_order_acquire);
+        size_t size;
+        std::memcpy(&size, memory, sizeof(size));
+        return {memory + sizeof(size), size};
+    }
+
+    SlotRecord store(std::string_view v, Arena &arena)
+    {
+        const char *previous = current.load(std::memory_order_relaxed);
+        current.store(write(v, arena), std::memory_order_release);
+        return recordOf(previous);
+    }
+
+    SlotRecord record() const
+    {
+        return recordOf(current.load(std::memory_order_relaxed));
+    }
+};
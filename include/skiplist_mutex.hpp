@@ -1,142 +1,11 @@
-#include <vector>
-#include <list>
-#include <optional>
-#include <memory>
-#include <shared_mutex>
+#pragma once
 
-template <typename TKey, typename TVal>
-class SkipListMutex
-{
-private:
-    struct Node
-    {
-        Node *down;
-        std::unique_ptr<Node> next;
-        std::optional<TKey> k;
-        std::optional<TVal> v;
+#include "skiplist_basic.hpp"
 
-        Node(Node *down, std::unique_ptr<Node> next, std::optional<TKey> k, std::optional<TVal> v) : down(down), next(std::move(next)), k(k), v(v) {}
-    };
-
-    std::vector<std::unique_ptr<Node>> heads;
-    mutable std::shared_mutex mutex;
-
-    Node *findInLevel(Node *current, const TKey &k) const
-    {
-        Node *next = current->next.get();
-        while (!(next == nullptr || next->k > k))
-        {
-            current = next;
-            next = current->next.get();
-        }
-        return current;
-    }
-
-    Node *upsertRec(Node *current, TKey k, TVal v)
-    {
-        if (!current)
-        {
-            return nullptr;
-        }
-        Node *insertNode = findInLevel(current, k);
-
-        // update case
-        if (insertNode->k && insertNode->k == k)
-        {
-            insertNode->v = v;
-            upsertRec(insertNode->down, k, v);
-            return nullptr;
-        }
-
-        // we need an insert at the leaf level
-        if (!insertNode->down)
-        {
-            auto newNode = std::make_unique<Node>(nullptr, nullptr, k, v);
-            return chainNode(insertNode, std::move(newNode));
-        }
-
-        auto childNode = upsertRec(insertNode->down, k, v);
-        if (!childNode)
-        {
-            return nullptr;
-        }
-
-        // insert at higher level with p=0.5
-        if (rand() & 1)
-        {
-            auto newNode = std::make_unique<Node>(childNode, nullptr, k, v);
-            return chainNode(insertNode, std::move(newNode));
-        }
-        return nullptr;
-    }
-
-    Node *chainNode(Node *previous, std::unique_ptr<Node> &&newNode)
-    {
-        Node *return_ptr = newNode.get();
-        newNode->next = std::move(previous->next);
-        previous->next = std::move(newNode);
-        return return_ptr;
-    }
-
-public:
-    SkipListMutex(size_t height)
-    {
-        Node *prev = nullptr;
-        for (size_t i = 0; i < height; i++)
-        {
-            auto newNode = std::make_unique<Node>(nullptr, nullptr, std::nullopt, std::nullopt);
-            if (prev)
-            {
-                prev->down = newNode.get();
-            }
-            prev = newNode.get();
-            heads.push_back(std::move(newNode));
-        }
-    }
-
-    ~SkipListMutex()
-    {
-        clear();
-    }
-
-    void clear()
-    {
-        for (int i = 0; i < heads.size(); i++)
-        {
-            auto clearPointer = std::move(heads[i]->next);
-            while (clearPointer)
-            {
-                clearPointer = std::move(clearPointer->next);
-            }
-        }
-        heads.clear();
-    }
-
-    void upsert(TKey k, TVal v)
-    {
-        std::unique_lock<std::shared_mutex> lock(mutex);
-        upsertRec(heads[0].get(), k, v);
-    }
-
-    std::optional<TVal> find(const TKey &k) const
-    {
-        std::shared_lock<std::shared_mutex> lock(mutex);
-        auto matchingNode = findInLevel(heads[0].get(), k);
-        while (matchingNode->down)
-        {
-            if (matchingNode->k && matchingNode->k == k)
-                return matchingNode->v;
-            matchingNode = findInLevel(matchingNode->down, k);
-        }
-        if (!matchingNode->k || matchingNode->k != k)
-        {
-            return std::nullopt;
-        }
-        return matchingNode->v;
-    }
-
-    static size_t getNodeSize()
-    {
-        return sizeof(Node);
-    }
-};
+// Mutex is any SharedMutex. std::shared_mutex is the baseline, with many
+// readers DistributedSharedMutex keeps them from contending on the lock.
+// Stats is NoStats or CountingStats, see skiplist_stats.hpp.
+template <typename TKey, typename TVal, typename Branching = BranchingHalf, typename Mutex = std::shared_mutex,
+          typename Stats = NoStats>
+using SkipListMutex =
+    BasicSkipList<TKey, TVal, Locked<Mutex>, Arena, DefaultComparator<TKey>, 32, Branching, Stats>;
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <ratio>
+
+// Branching factors for the tower height distribution: a key reaching some
+// level is promoted to the next one with probability p. Smaller values
+// trade search depth for memory.
+using BranchingHalf = std::ratio<1, 2>;
+using BranchingQuarter = std::ratio<1, 4>;
+using BranchingInverseE = std::ratio<367879441171, 1000000000000>;
+
+// xorshift64* generator (Vigna, "An experimental exploration of Marsaglia's
+// xorshift generators, scrambled"). Small, fast and good enough to pick
+// tower heights, not suitable for anything else. Its low bits are the
+// weakest, consumers should use the high ones.
+class XorShift64Star
+{
+private:
+    uint64_t state;
+
+public:
+    static constexpr uint64_t DEFAULT_SEED = 0x9E3779B97F4A7C15ull;
+
+    explicit XorShift64Star(uint64_t seed = DEFAULT_SEED) : state(seed != 0 ? seed : DEFAULT_SEED) {}
+
+    uint64_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+};
+
+// Draws tower heights in [1, maxHeight] from a geometric distribution with
+// promotion probability Branching. For p = 1/2^b a single random number
+// decides the whole tower: every b leading zero bits add one level.
+// Other probabilities fall back to one draw per promotion.
+template <typename Branching = BranchingHalf>
+class TowerHeightGenerator
+{
+private:
+    static_assert(Branching::num > 0 && Branching::num < Branching::den,
+                  "promotion probability must be in (0, 1)");
+
+    static constexpr bool POWER_OF_TWO =
+        Branching::num == 1 && std::has_single_bit(static_cast<uint64_t>(Branching::den));
+    static constexpr int BITS_PER_LEVEL = std::countr_zero(static_cast<uint64_t>(Branching::den));
+    static constexpr uint64_t PROMOTION_THRESHOLD = static_cast<uint64_t>(
+        static_cast<long double>(Branching::num) / Branching::den * 18446744073709551616.0L);
+
+    XorShift64Star rng;
+
+public:
+    explicit TowerHeightGenerator(uint64_t seed = XorShift64Star::DEFAULT_SEED) : rng(seed) {}
+
+    size_t next(size_t maxHeight)
+    {
+        size_t height = 1;
+        if constexpr (POWER_OF_TWO)
+        {
+            height += std::countl_zero(rng.next()) / BITS_PER_LEVEL;
+        }
+        else
+        {
+            while (height < maxHeight && rng.next() < PROMOTION_THRESHOLD)
+            {
+                height++;
+            }
+        }
+        return height < maxHeight ? height : maxHeight;
+    }
+
+    static constexpr double probability()
+    {
+        return static_cast<double>(Branching::num) / Branching::den;
+    }
+};
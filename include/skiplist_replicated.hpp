@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "numa.hpp"
+#include "skiplist_atomic_sw.hpp"
+
+// One SkipListAtomicSingleWriter per NUMA node, each with its nodes in
+// memory of that node. The single writer applies every write to all
+// replicas in turn, readers search the replica of the node they run on, so
+// their pointer chasing never crosses the interconnect. Writes cost one
+// upsert per replica; this pays off for read-mostly lists on machines with
+// more than one socket.
+//
+// A write becomes visible replica by replica. A reader thread sticks to
+// the replica of its home node, the node it first searched from unless
+// set with setThreadNode(), so it never sees a write disappear again.
+// Threads should be pinned to their node, see NumaTopology. With Stats
+// enabled a write is counted once per replica.
+template <typename TKey, typename TVal, typename Branching = BranchingHalf,
+          typename Comparator = DefaultComparator<TKey>, typename Stats = NoStats>
+class ReplicatedSkipList
+{
+public:
+    using Replica = SkipListAtomicSingleWriter<TKey, TVal, Branching, Comparator, Stats>;
+
+private:
+    std::vector<std::unique_ptr<Replica>> replicas;
+
+    static int &threadNode()
+    {
+        thread_local int node = -1;
+        return node;
+    }
+
+public:
+    // replicaCount 0 creates one replica per node, replica i lives on node
+    // i modulo the number of nodes. On a single node the arenas are not
+    // bound, mbind may be missing or forbidden there.
+    explicit ReplicatedSkipList(size_t height, size_t replicaCount = 0,
+                                size_t arenaBlockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : ReplicatedSkipList(height, ArenaOptions{.blockSize = arenaBlockSize}, replicaCount)
+    {
+    }
+
+    // arenaOptions apply to every replica, except for the NUMA node
+    ReplicatedSkipList(size_t height, const ArenaOptions &arenaOptions, size_t replicaCount = 0)
+    {
+        size_t nodes = NumaTopology::nodes();
+        if (replicaCount == 0)
+        {
+            replicaCount = nodes;
+        }
+        for (size_t i = 0; i < replicaCount; i++)
+        {
+            ArenaOptions options = arenaOptions;
+            options.numaNode = -1;
+            if (nodes > 1)
+            {
+                options.numaNode = static_cast<int>(i % nodes);
+            }
+            replicas.push_back(std::make_unique<Replica>(height, options));
+        }
+    }
+
+    static size_t heightForCapacity(size_t expectedKeys)
+    {
+        return Replica::heightForCapacity(expectedKeys);
+    }
+
+    // Makes node the home node of the calling thread.
+    static void setThreadNode(int node)
+    {
+        threadNode() = node;
+    }
+
+    void upsert(const TKey &k, const TVal &v)
+    {
+        for (auto &replica : replicas)
+        {
+            replica->upsert(k, v);
+        }
+    }
+
+    // Lets erase() remove keys, see SkipListAtomicSingleWriter. Must be
+    // called before the list is shared with readers.
+    void useReclamation()
+    {
+        for (auto &replica : replicas)
+        {
+            replica->useReclamation();
+        }
+    }
+
+    // requires useReclamation()
+    bool erase(const TKey &k)
+    {
+        bool erased = false;
+        for (auto &replica : replicas)
+        {
+            erased = replica->erase(k);
+        }
+        return erased;
+    }
+
+    std::optional<TVal> find(const TKey &k) const
+    {
+        return local().find(k);
+    }
+
+    // the replica of the calling thread's home node
+    const Replica &local() const
+    {
+        int &node = threadNode();
+        if (node < 0)
+        {
+            node = NumaTopology::currentNode();
+        }
+        return *replicas[static_cast<size_t>(node) % replicas.size()];
+    }
+
+    const Replica &replica(size_t i) const
+    {
+        return *replicas[i];
+    }
+
+    size_t replicaCount() const
+    {
+        return replicas.size();
+    }
+
+    // bytes reserved by all replicas
+    size_t memoryUsage() const
+    {
+        size_t total = 0;
+        for (const auto &replica : replicas)
+        {
+            total += replica->memoryUsage();
+        }
+        return total;
+    }
+};
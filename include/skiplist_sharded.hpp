@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "skiplist_atomic_sw.hpp"
+
+// Spreads keys evenly over the shards. The hash is scrambled with a
+// multiplicative step because std::hash is the identity for integers.
+template <typename TKey>
+struct HashPartitioner
+{
+    size_t operator()(const TKey &k, size_t shards) const
+    {
+        uint64_t hash = static_cast<uint64_t>(std::hash<TKey>()(k)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>((hash >> 32) % shards);
+    }
+};
+
+// Assigns contiguous key ranges to shards: shard i holds the keys in
+// [boundaries[i - 1], boundaries[i]), the last shard everything from the
+// last boundary on. Keeps scans of a narrow range on few shards.
+template <typename TKey, typename Comparator = DefaultComparator<TKey>>
+class RangePartitioner
+{
+private:
+    std::vector<TKey> boundaries;
+    [[no_unique_address]] Comparator compare;
+
+public:
+    explicit RangePartitioner(std::vector<TKey> boundaries) : boundaries(std::move(boundaries))
+    {
+        if (std::adjacent_find(this->boundaries.begin(), this->boundaries.end(),
+                               [this](const TKey &a, const TKey &b) { return !compare(a, b); }) !=
+            this->boundaries.end())
+        {
+            throw std::invalid_argument("range boundaries must be strictly increasing");
+        }
+    }
+
+    size_t operator()(const TKey &k, size_t shards) const
+    {
+        auto shard = static_cast<size_t>(std::upper_bound(boundaries.begin(), boundaries.end(), k, compare) -
+                                         boundaries.begin());
+        return shard < shards ? shard : shards - 1;
+    }
+};
+
+// Partitions keys over Shards independent SkipListAtomicSingleWriter
+// instances so that writes to different shards proceed in parallel. Every
+// shard keeps the single writer protocol: writes through this class take
+// the shard's writer lock, which is uncontended if each shard is fed by
+// its own thread (see shardOf()). Reads never lock, ordered iteration
+// merges the shards.
+template <typename TKey, typename TVal, size_t Shards, typename Partitioner = HashPartitioner<TKey>,
+          typename Branching = BranchingHalf, typename Comparator = DefaultComparator<TKey>,
+          typename Stats = NoStats>
+class ShardedSkipList
+{
+    static_assert(Shards > 0, "a sharded list needs at least one shard");
+
+public:
+    using Shard = SkipListAtomicSingleWriter<TKey, TVal, Branching, Comparator, Stats>;
+
+private:
+    // writer lock and list of a shard on their own cache lines, writers
+    // of different shards never share a line
+    struct alignas(Arena::CACHE_LINE_SIZE) PaddedShard
+    {
+        std::mutex writeMutex;
+        alignas(Arena::CACHE_LINE_SIZE) Shard list;
+
+        PaddedShard(size_t height, size_t arenaBlockSize) : list(height, arenaBlockSize) {}
+    };
+
+    std::unique_ptr<PaddedShard> shards[Shards];
+    Partitioner partitioner;
+    [[no_unique_address]] Comparator compare;
+
+    PaddedShard &shardFor(const TKey &k) const
+    {
+        return *shards[shardOf(k)];
+    }
+
+public:
+    // Merges the shard iterators with a binary heap on their current keys.
+    // Like the shard iterators it pins an epoch on every shard.
+    class Iterator
+    {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<TKey, TVal>;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+
+        Iterator() = default;
+
+        const TKey &key() const
+        {
+            return cursors[heap.front()].key();
+        }
+
+        TVal value() const
+        {
+            return cursors[heap.front()].value();
+        }
+
+        value_type operator*() const
+        {
+            return {key(), value()};
+        }
+
+        Iterator &operator++()
+        {
+            std::pop_heap(heap.begin(), heap.end(), after());
+            size_t shard = heap.back();
+            if (++cursors[shard] == typename Shard::Iterator())
+            {
+                heap.pop_back();
+            }
+            else
+            {
+                std::push_heap(heap.begin(), heap.end(), after());
+            }
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator &other) const
+        {
+            if (heap.empty() || other.heap.empty())
+            {
+                return heap.empty() && other.heap.empty();
+            }
+            return heap.front() == other.heap.front() &&
+                   cursors[heap.front()] == other.cursors[other.heap.front()];
+        }
+
+        bool operator!=(const Iterator &other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        friend class ShardedSkipList;
+
+        const ShardedSkipList *owner = nullptr;
+        std::vector<typename Shard::Iterator> cursors;
+        // shards that are not exhausted, the one with the smallest key first
+        std::vector<size_t> heap;
+
+        template <typename Start>
+        Iterator(const ShardedSkipList &owner, Start &&start) : owner(&owner)
+        {
+            cursors.reserve(Shards);
+            for (size_t i = 0; i < Shards; i++)
+            {
+                cursors.push_back(start(owner.shards[i]->list));
+                if (cursors.back() != typename Shard::Iterator())
+                {
+                    heap.push_back(i);
+                }
+            }
+            std::make_heap(heap.begin(), heap.end(), after());
+        }
+
+        // heap order, the top is the shard with the smallest key
+        auto after() const
+        {
+            return [this](size_t a, size_t b) { return owner->compare(cursors[b].key(), cursors[a].key()); };
+        }
+    };
+
+    explicit ShardedSkipList(size_t height, Partitioner partitioner = Partitioner(),
+                             size_t arenaBlockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : partitioner(std::move(partitioner))
+    {
+        for (auto &shard : shards)
+        {
+            shard = std::make_unique<PaddedShard>(height, arenaBlockSize);
+        }
+    }
+
+    // shard a key belongs to
+    size_t shardOf(const TKey &k) const
+    {
+        return partitioner(k, Shards);
+    }
+
+    // Direct access to a shard, e.g. for a pipeline that dedicates one
+    // writer thread to every shard and bypasses the writer locks. Writes
+    // to a shard must then only come from that thread.
+    Shard &shard(size_t index)
+    {
+        return shards[index]->list;
+    }
+
+    const Shard &shard(size_t index) const
+    {
+        return shards[index]->list;
+    }
+
+    void upsert(const TKey &k, const TVal &v)
+    {
+        PaddedShard &shard = shardFor(k);
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        shard.list.upsert(k, v);
+    }
+
+    // Lets erase() remove keys, see SkipListAtomicSingleWriter. Must be
+    // called before the list is shared with readers.
+    void useReclamation()
+    {
+        for (auto &shard : shards)
+        {
+            shard->list.useReclamation();
+        }
+    }
+
+    // requires useReclamation()
+    bool erase(const TKey &k)
+    {
+        PaddedShard &shard = shardFor(k);
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        return shard.list.erase(k);
+    }
+
+    // Splits a range of (key, value) pairs by shard and upserts every part
+    // as a batch under one acquisition of its shard's lock.
+    template <typename It>
+    void upsertBatch(It begin, It end)
+    {
+        std::vector<std::pair<TKey, TVal>> parts[Shards];
+        for (; begin != end; ++begin)
+        {
+            parts[shardOf(std::get<0>(*begin))].emplace_back(std::get<0>(*begin), std::get<1>(*begin));
+        }
+        for (size_t i = 0; i < Shards; i++)
+        {
+            if (!parts[i].empty())
+            {
+                std::lock_guard<std::mutex> lock(shards[i]->writeMutex);
+                shards[i]->list.upsertBatch(parts[i].begin(), parts[i].end());
+            }
+        }
+    }
+
+    std::optional<TVal> find(const TKey &k) const
+    {
+        return shardFor(k).list.find(k);
+    }
+
+    Iterator begin() const
+    {
+        return Iterator(*this, [](const Shard &shard) { return shard.begin(); });
+    }
+
+    Iterator end() const
+    {
+        return Iterator();
+    }
+
+    // iterator to the first key not less than k
+    Iterator seek(const TKey &k) const
+    {
+        return Iterator(*this, [&k](const Shard &shard) { return shard.seek(k); });
+    }
+
+    // Calls callback(key, value) for every key in [from, to) in order.
+    template <typename Callback>
+    void scan(const TKey &from, const TKey &to, Callback &&callback) const
+    {
+        for (auto it = seek(from); it != end() && compare(it.key(), to); ++it)
+        {
+            callback(it.key(), it.value());
+        }
+    }
+
+    size_t memoryUsage() const
+    {
+        size_t total = 0;
+        for (const auto &shard : shards)
+        {
+            total += shard->list.memoryUsage();
+        }
+        return total;
+    }
+};
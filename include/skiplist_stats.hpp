@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "latency_histogram.hpp"
+
+// Counters collected by a stats policy, summed over all threads.
+struct SkipListStats
+{
+    static constexpr size_t MAX_LEVELS = 32;
+
+    uint64_t finds = 0;
+    uint64_t inserts = 0;
+    uint64_t updates = 0;
+    // key comparisons made while searching, by finds and upserts
+    uint64_t comparisons = 0;
+    // nodes passed on every level while searching
+    uint64_t visits[MAX_LEVELS] = {};
+    // inserted towers by height, towerHeights[0] counts height 1
+    uint64_t towerHeights[MAX_LEVELS] = {};
+    // nanoseconds per find and upsert, empty unless the policy times them
+    LatencyHistogram findLatency;
+    LatencyHistogram upsertLatency;
+
+    uint64_t searches() const
+    {
+        return finds + inserts + updates;
+    }
+
+    double comparisonsPerSearch() const
+    {
+        return searches() > 0 ? static_cast<double>(comparisons) / searches() : 0;
+    }
+
+    // share of upserts that found their key already present
+    double updateRatio() const
+    {
+        return inserts + updates > 0 ? static_cast<double>(updates) / (inserts + updates) : 0;
+    }
+
+    SkipListStats &operator+=(const SkipListStats &other)
+    {
+        finds += other.finds;
+        inserts += other.inserts;
+        updates += other.updates;
+        comparisons += other.comparisons;
+        for (size_t level = 0; level < MAX_LEVELS; level++)
+        {
+            visits[level] += other.visits[level];
+            towerHeights[level] += other.towerHeights[level];
+        }
+        findLatency += other.findLatency;
+        upsertLatency += other.upsertLatency;
+        return *this;
+    }
+};
+
+// Stats policy of the skiplists. Calls into it compile to nothing, so
+// lists built with it are exactly as fast as without instrumentation.
+struct NoStats
+{
+    static constexpr bool ENABLED = false;
+
+    // held for the duration of a find or upsert by policies that time them
+    struct Timer
+    {
+    };
+
+    static Timer timeFind()
+    {
+        return {};
+    }
+
+    static Timer timeUpsert()
+    {
+        return {};
+    }
+
+    static void find() {}
+    static void insert(size_t) {}
+    static void update() {}
+    static void compare() {}
+    static void visit(size_t) {}
+};
+
+// Stats policy counting into thread local counters, so instrumented hot
+// paths never write to a cache line another thread uses. collect() sums
+// the counters of all live threads and of the threads that already exited.
+// The counters are shared by every list using the policy. With Timed, every
+// find and upsert is also timed into thread local latency histograms,
+// which costs two clock reads per call.
+template <bool Timed>
+class BasicCountingStats
+{
+private:
+    struct Latencies
+    {
+        LatencyHistogram find;
+        LatencyHistogram upsert;
+    };
+
+    struct NoLatencies
+    {
+    };
+
+    // records the time from its construction to its destruction
+    class ScopedTimer
+    {
+    private:
+        LatencyHistogram &histogram;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit ScopedTimer(LatencyHistogram &histogram)
+            : histogram(histogram), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        ~ScopedTimer()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            histogram.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    };
+
+public:
+    static constexpr bool ENABLED = true;
+
+    static auto timeFind()
+    {
+        if constexpr (Timed)
+        {
+            return ScopedTimer(local().latencies.find);
+        }
+        else
+        {
+            return NoStats::Timer{};
+        }
+    }
+
+    static auto timeUpsert()
+    {
+        if constexpr (Timed)
+        {
+            return ScopedTimer(local().latencies.upsert);
+        }
+        else
+        {
+            return NoStats::Timer{};
+        }
+    }
+
+    static void find()
+    {
+        bump(local().finds);
+    }
+
+    static void insert(size_t height)
+    {
+        Counters &counters = local();
+        bump(counters.inserts);
+        bump(counters.towerHeights[std::min(height, SkipListStats::MAX_LEVELS) - 1]);
+    }
+
+    static void update()
+    {
+        bump(local().updates);
+    }
+
+    static void compare()
+    {
+        bump(local().comparisons);
+    }
+
+    static void visit(size_t level)
+    {
+        bump(local().visits[std::min(level, SkipListStats::MAX_LEVELS - 1)]);
+    }
+
+    // Safe to call while other threads count, their latest increments may
+    // be missing.
+    static SkipListStats collect()
+    {
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        SkipListStats result = registry.exited;
+        for (const Counters *counters : registry.live)
+        {
+            result += counters->snapshot();
+        }
+        return result;
+    }
+
+    // Zeroes all counters. Increments racing with it may survive.
+    static void reset()
+    {
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.exited = SkipListStats();
+        for (Counters *counters : registry.live)
+        {
+            counters->reset();
+        }
+    }
+
+private:
+    // written by the owning thread only, atomic so collect() may read them
+    struct Counters
+    {
+        std::atomic<uint64_t> finds{0};
+        std::atomic<uint64_t> inserts{0};
+        std::atomic<uint64_t> updates{0};
+        std::atomic<uint64_t> comparisons{0};
+        std::atomic<uint64_t> visits[SkipListStats::MAX_LEVELS] = {};
+        std::atomic<uint64_t> towerHeights[SkipListStats::MAX_LEVELS] = {};
+        [[no_unique_address]] std::conditional_t<Timed, Latencies, NoLatencies> latencies;
+
+        SkipListStats snapshot() const
+        {
+            SkipListStats result;
+            result.finds = finds.load(std::memory_order_relaxed);
+            result.inserts = inserts.load(std::memory_order_relaxed);
+            result.updates = updates.load(std::memory_order_relaxed);
+            result.comparisons = comparisons.load(std::memory_order_relaxed);
+            for (size_t level = 0; level < SkipListStats::MAX_LEVELS; level++)
+            {
+                result.visits[level] = visits[level].load(std::memory_order_relaxed);
+                result.towerHeights[level] = towerHeights[level].load(std::memory_order_relaxed);
+            }
+            if constexpr (Timed)
+            {
+                result.findLatency = latencies.find;
+                result.upsertLatency = latencies.upsert;
+            }
+            return result;
+        }
+
+        void reset()
+        {
+            finds.store(0, std::memory_order_relaxed);
+            inserts.store(0, std::memory_order_relaxed);
+            updates.store(0, std::memory_order_relaxed);
+            comparisons.store(0, std::memory_order_relaxed);
+            for (size_t level = 0; level < SkipListStats::MAX_LEVELS; level++)
+            {
+                visits[level].store(0, std::memory_order_relaxed);
+                towerHeights[level].store(0, std::memory_order_relaxed);
+            }
+            if constexpr (Timed)
+            {
+                latencies.find.reset();
+                latencies.upsert.reset();
+            }
+        }
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<Counters *> live;
+        SkipListStats exited;
+    };
+
+    // registers the thread's counters on first use, folds them into the
+    // exited totals when the thread ends
+    struct ThreadCounters
+    {
+        Counters counters;
+
+        ThreadCounters()
+        {
+            Registry &registry = getRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.live.push_back(&counters);
+        }
+
+        ~ThreadCounters()
+        {
+            Registry &registry = getRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.exited += counters.snapshot();
+            registry.live.erase(std::find(registry.live.begin(), registry.live.end(), &counters));
+        }
+    };
+
+    static Registry &getRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    static Counters &local()
+    {
+        thread_local ThreadCounters threadCounters;
+        return threadCounters.counters;
+    }
+
+    // only the owning thread writes, a read-modify-write is not needed
+    static void bump(std::atomic<uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+using CountingStats = BasicCountingStats<false>;
+using TimingStats = BasicCountingStats<true>;
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "skiplist_atomic_sw.hpp"
+
+// A user key together with the version it was written in. tag holds the
+// sequence number shifted left by one, the low bit is set for values and
+// clear for deletions.
+template <typename TKey>
+struct VersionedKey
+{
+    TKey key;
+    uint64_t tag;
+};
+
+// Orders by user key and, within a key, newest version first, so seeking
+// to (key, snapshot) lands on the newest version visible in the snapshot.
+template <typename TKey, typename Comparator>
+struct VersionedKeyComparator
+{
+    [[no_unique_address]] Comparator compare;
+
+    bool operator()(const VersionedKey<TKey> &a, const VersionedKey<TKey> &b) const
+    {
+        if (compare(a.key, b.key))
+        {
+            return true;
+        }
+        if (compare(b.key, a.key))
+        {
+            return false;
+        }
+        return a.tag > b.tag;
+    }
+
+    // the user key decides the order first, so its prefix still agrees
+    static uint64_t prefix(const VersionedKey<TKey> &k)
+        requires PrefixComparator<Comparator, TKey>
+    {
+        return Comparator::prefix(k.key);
+    }
+};
+
+template <typename TKey>
+struct KeyStorage<VersionedKey<TKey>>
+{
+    static size_t payloadSize(const VersionedKey<TKey> &k)
+    {
+        return KeyStorage<TKey>::payloadSize(k.key);
+    }
+
+    static VersionedKey<TKey> store(const VersionedKey<TKey> &k, char *payload)
+    {
+        return {KeyStorage<TKey>::store(k.key, payload), k.tag};
+    }
+};
+
+// Multi version list on top of SkipListAtomicSingleWriter, in the style of
+// LevelDB and RocksDB memtables. Every upsert and erase is a new version
+// with its own sequence number, old versions are kept. Readers take a
+// snapshot, the sequence number of the last completed write, and see the
+// list as of that write without any locking: versions written later are
+// skipped, even while they are being inserted.
+template <typename TKey, typename TVal, typename Branching = BranchingHalf,
+          typename Comparator = DefaultComparator<TKey>>
+class VersionedSkipList
+{
+public:
+    static constexpr uint64_t MAX_SEQUENCE = std::numeric_limits<uint64_t>::max() >> 1;
+
+private:
+    using Key = VersionedKey<TKey>;
+    using List = SkipListAtomicSingleWriter<Key, TVal, Branching, VersionedKeyComparator<TKey, Comparator>>;
+
+    static constexpr uint64_t VALUE = 1;
+    static constexpr uint64_t DELETION = 0;
+
+    List list;
+    [[no_unique_address]] Comparator compare;
+    // published by the writer once the version is linked
+    std::atomic<uint64_t> lastSequence{0};
+
+    static void checkSequence(uint64_t sequence, uint64_t last)
+    {
+        if (sequence <= last || sequence > MAX_SEQUENCE)
+        {
+            throw std::invalid_argument("sequence numbers must increase and stay below MAX_SEQUENCE");
+        }
+    }
+
+    uint64_t write(const TKey &k, const TVal &v, uint64_t sequence, uint64_t type)
+    {
+        checkSequence(sequence, lastSequence.load(std::memory_order_relaxed));
+        list.upsert(Key{k, sequence << 1 | type}, v);
+        lastSequence.store(sequence, std::memory_order_release);
+        return sequence;
+    }
+
+public:
+    // Iterates the newest version of every key visible in a snapshot,
+    // skipping deleted keys. Pins an epoch like the underlying iterator.
+    class Iterator
+    {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<TKey, TVal>;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+
+        Iterator() = default;
+
+        const TKey &key() const
+        {
+            return current.key().key;
+        }
+
+        TVal value() const
+        {
+            return current.value();
+        }
+
+        // sequence number of the version the iterator is on
+        uint64_t sequence() const
+        {
+            return current.key().tag >> 1;
+        }
+
+        value_type operator*() const
+        {
+            return {key(), value()};
+        }
+
+        Iterator &operator++()
+        {
+            skipKey();
+            settle();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator &other) const
+        {
+            return current == other.current;
+        }
+
+        bool operator!=(const Iterator &other) const
+        {
+            return current != other.current;
+        }
+
+    private:
+        friend class VersionedSkipList;
+
+        Iterator(const VersionedSkipList &owner, typename List::Iterator current, uint64_t snapshot)
+            : owner(&owner), current(std::move(current)), snapshot(snapshot)
+        {
+            settle();
+        }
+
+        const VersionedSkipList *owner = nullptr;
+        typename List::Iterator current;
+        uint64_t snapshot = 0;
+
+        // moves past the remaining versions of the current key
+        void skipKey()
+        {
+            TKey k = key();
+            do
+            {
+                ++current;
+            } while (current != typename List::Iterator() && !owner->compare(k, key()));
+        }
+
+        // moves to the first visible version that is not a deletion
+        void settle()
+        {
+            while (current != typename List::Iterator())
+            {
+                uint64_t tag = current.key().tag;
+                if (tag >> 1 > snapshot)
+                {
+                    ++current;
+                }
+                else if ((tag & 1) == VALUE)
+                {
+                    return;
+                }
+                else
+                {
+                    skipKey();
+                }
+            }
+        }
+    };
+
+    explicit VersionedSkipList(size_t height, size_t arenaBlockSize = Arena::DEFAULT_BLOCK_SIZE)
+        : list(height, arenaBlockSize)
+    {
+    }
+
+    // Writes a new version of k under the next sequence number and
+    // returns it.
+    uint64_t upsert(const TKey &k, const TVal &v)
+    {
+        return write(k, v, lastSequence.load(std::memory_order_relaxed) + 1, VALUE);
+    }
+
+    // Writes a version under a sequence number assigned by the caller,
+    // e.g. from a write ahead log. It must be greater than all earlier ones.
+    uint64_t upsert(const TKey &k, const TVal &v, uint64_t sequence)
+    {
+        return write(k, v, sequence, VALUE);
+    }
+
+    // Writes a range of (key, value) pairs atomically: they get consecutive
+    // sequence numbers, but only the last one is published, so a snapshot
+    // sees either all of them or none. Returns the last sequence number.
+    template <typename It>
+    uint64_t upsertBatch(It begin, It end)
+    {
+        uint64_t sequence = lastSequence.load(std::memory_order_relaxed);
+        for (; begin != end; ++begin)
+        {
+            sequence++;
+            checkSequence(sequence, sequence - 1);
+            list.upsert(Key{std::get<0>(*begin), sequence << 1 | VALUE}, std::get<1>(*begin));
+        }
+        lastSequence.store(sequence, std::memory_order_release);
+        return sequence;
+    }
+
+    // Writes a deletion of k, snapshots from now on no longer see the key.
+    uint64_t erase(const TKey &k)
+    {
+        return write(k, TVal(), lastSequence.load(std::memory_order_relaxed) + 1, DELETION);
+    }
+
+    uint64_t erase(const TKey &k, uint64_t sequence)
+    {
+        return write(k, TVal(), sequence, DELETION);
+    }
+
+    // sequence number of the last completed write
+    uint64_t snapshot() const
+    {
+        return lastSequence.load(std::memory_order_acquire);
+    }
+
+    // value of k as of the snapshot
+    std::optional<TVal> find(const TKey &k, uint64_t snapshot) const
+    {
+        auto it = list.seek(Key{k, snapshot << 1 | VALUE});
+        if (it == list.end() || compare(k, it.key().key) || (it.key().tag & 1) == DELETION)
+        {
+            return std::nullopt;
+        }
+        return it.value();
+    }
+
+    std::optional<TVal> find(const TKey &k) const
+    {
+        return find(k, snapshot());
+    }
+
+    Iterator begin(uint64_t snapshot) const
+    {
+        return Iterator(*this, list.begin(), snapshot);
+    }
+
+    Iterator begin() const
+    {
+        return begin(snapshot());
+    }
+
+    Iterator end() const
+    {
+        return Iterator();
+    }
+
+    // iterator to the first key not less than k visible in the snapshot
+    Iterator seek(const TKey &k, uint64_t snapshot) const
+    {
+        return Iterator(*this, list.seek(Key{k, MAX_SEQUENCE << 1 | VALUE}), snapshot);
+    }
+
+    Iterator seek(const TKey &k) const
+    {
+        return seek(k, snapshot());
+    }
+
+    // Bytes reserved by the node arena, old versions included.
+    size_t memoryUsage() const
+    {
+        return list.memoryUsage();
+    }
+};
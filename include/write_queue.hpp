@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mpsc_queue.hpp"
+#include "skiplist_atomic_sw.hpp"
+
+// Lets any number of threads write to a list with a single writer
+// contract. Producers enqueue upserts into a lock-free ring buffer and
+// return at once; a dedicated writer thread drains the buffer in groups of
+// up to MAX_BATCH and applies each group with one upsertBatch() call, so
+// the list stays warm in the writer's cache. Readers use the list
+// directly, an upsert is visible once it has been applied.
+//
+// The list must not be written by anyone else while the queue exists.
+// Keys and values are queued by value, views like std::string_view must
+// stay valid until their upsert has been applied.
+template <typename TKey, typename TVal, typename List = SkipListAtomicSingleWriter<TKey, TVal>>
+class WriteQueue
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 4096;
+    static constexpr size_t MAX_BATCH = 256;
+
+private:
+    struct Entry
+    {
+        enum class Kind
+        {
+            Upsert,
+            Flush,
+            Stop
+        };
+
+        Kind kind = Kind::Upsert;
+        TKey k{};
+        TVal v{};
+        // fulfilled once the entry and everything before it is applied
+        std::optional<std::promise<void>> done;
+    };
+
+    List &list;
+    MpscRingBuffer<Entry> queue;
+    std::thread writer;
+
+    void push(Entry entry)
+    {
+        while (!queue.tryPush(entry))
+        {
+            // full, the writer is behind: let it run
+            std::this_thread::yield();
+        }
+        queue.notify();
+    }
+
+    void apply(std::vector<std::pair<TKey, TVal>> &batch, std::vector<std::promise<void>> &completions)
+    {
+        try
+        {
+            list.upsertBatch(batch.begin(), batch.end());
+            for (auto &completion : completions)
+            {
+                completion.set_value();
+            }
+        }
+        catch (...)
+        {
+            for (auto &completion : completions)
+            {
+                completion.set_exception(std::current_exception());
+            }
+        }
+        batch.clear();
+        completions.clear();
+    }
+
+    void run()
+    {
+        std::vector<std::pair<TKey, TVal>> batch;
+        std::vector<std::promise<void>> completions;
+        batch.reserve(MAX_BATCH);
+
+        bool stopping = false;
+        while (!stopping)
+        {
+            size_t seen = queue.pushed();
+            Entry entry;
+            while (batch.size() < MAX_BATCH && queue.tryPop(entry))
+            {
+                if (entry.kind == Entry::Kind::Upsert)
+                {
+                    batch.emplace_back(std::move(entry.k), std::move(entry.v));
+                }
+                if (entry.done)
+                {
+                    completions.push_back(std::move(*entry.done));
+                    entry.done.reset();
+                }
+                if (entry.kind == Entry::Kind::Stop)
+                {
+                    stopping = true;
+                    break;
+                }
+            }
+
+            if (batch.empty() && completions.empty())
+            {
+                if (!stopping)
+                {
+                    queue.waitPushed(seen);
+                }
+                continue;
+            }
+            apply(batch, completions);
+        }
+    }
+
+public:
+    explicit WriteQueue(List &list, size_t capacity = DEFAULT_CAPACITY)
+        : list(list), queue(capacity), writer([this]() { run(); })
+    {
+    }
+
+    WriteQueue(const WriteQueue &) = delete;
+    WriteQueue &operator=(const WriteQueue &) = delete;
+
+    // applies everything enqueued so far before returning
+    ~WriteQueue()
+    {
+        Entry stop;
+        stop.kind = Entry::Kind::Stop;
+        push(std::move(stop));
+        writer.join();
+    }
+
+    void upsert(TKey k, TVal v)
+    {
+        Entry entry;
+        entry.k = std::move(k);
+        entry.v = std::move(v);
+        push(std::move(entry));
+    }
+
+    // The future becomes ready once the upsert is visible to readers.
+    std::future<void> upsertAsync(TKey k, TVal v)
+    {
+        Entry entry;
+        entry.k = std::move(k);
+        entry.v = std::move(v);
+        std::future<void> result = entry.done.emplace().get_future();
+        push(std::move(entry));
+        return result;
+    }
+
+    // Blocks until every upsert this thread enqueued before is applied.
+    void flush()
+    {
+        Entry entry;
+        entry.kind = Entry::Kind::Flush;
+        std::future<void> result = entry.done.emplace().get_future();
+        push(std::move(entry));
+        result.get();
+    }
+};
@@ -1,5 +1,7 @@
+import argparse
 import subprocess
 import csv
+import json
 import re
 from typing import NamedTuple
 from pathlib import Path
@@ -51,18 +53,18 @@ def parse_output(output: str) -> BenchmarkResult:
     )
 
 
-def find_load_test_executable() -> Path:
-    """Find the concurrent_load_test executable in common build directories."""
+def find_load_test_executable(name: str = "concurrent_load_test") -> Path:
+    """Find a load test executable in common build directories."""
     current_dir = Path(__file__).parent.parent
     common_build_dirs = ["build", "build-release"]
 
     for build_dir in common_build_dirs:
-        executable = current_dir / build_dir / "concurrent_load_test"
+        executable = current_dir / build_dir / name
         if executable.exists():
             return executable
 
     raise FileNotFoundError(
-        "Could not find concurrent_load_test executable. "
+        f"Could not find {name} executable. "
         "Please build the project first using:\n"
         "mkdir build && cd build && cmake -DCMAKE_BUILD_TYPE=Release .. && make"
     )
@@ -86,11 +88,7 @@ def run_benchmark(
         raise
 
 
-def main():
-    # Ensure output directory exists
-    output_dir = Path(__file__).parent / "results"
-    output_dir.mkdir(exist_ok=True)
-
+def run_readers_suite(output_dir: Path):
     try:
         executable = find_load_test_executable()
     except FileNotFoundError as e:
@@ -149,5 +147,124 @@ def main():
     print(f"\nBenchmark results have been written to {output_file}")
 
 
+
+WORKLOAD_FIELDS = [
+    "list",
+    "workload",
+    "distribution",
+    "keys",
+    "key_type",
+    "threads",
+    "pinned",
+    "seed",
+    "operation",
+    "count",
+    "throughput",
+    "p50_ns",
+    "p90_ns",
+    "p99_ns",
+    "p999_ns",
+    "max_ns",
+]
+
+
+def run_workload(executable: Path, **options) -> list[dict]:
+    """Run one workload_benchmark configuration, one row per operation."""
+    cmd = [str(executable), "--format=json"]
+    for name, value in options.items():
+        flag = "--" + name.replace("_", "-")
+        if value is True:
+            cmd.append(flag)
+        elif value is not False:
+            cmd.append(f"{flag}={value}")
+    result = subprocess.run(cmd, capture_output=True, text=True, check=True)
+    report = json.loads(result.stdout)
+    operations = report.pop("operations")
+    return [{**report, **operation} for operation in operations]
+
+
+def run_workloads_suite(output_dir: Path, args):
+    try:
+        executable = find_load_test_executable("workload_benchmark")
+    except FileNotFoundError as e:
+        print(e)
+        return
+
+    rows = []
+    for key_type in args.key_types:
+        lists = args.lists
+        if key_type == "string":
+            lists = [l for l in lists if l in ("atomic_sw", "atomic_sw_filter", "mutex", "sharded")]
+        for keys in args.keys:
+            for workload in args.workloads:
+                for distribution in args.distributions:
+                    for threads in args.threads:
+                        for list_name in lists:
+                            if workload == "E" and list_name in ("mutex", "distributed_mutex", "atomic_mw"):
+                                continue
+                            print(
+                                f"Running {list_name}: workload {workload}, {distribution}, "
+                                f"{keys} {key_type} keys, {threads} threads..."
+                            )
+                            rows += run_workload(
+                                executable,
+                                list=list_name,
+                                workload=workload,
+                                distribution=distribution,
+                                keys=keys,
+                                key_type=key_type,
+                                threads=threads,
+                                seconds=args.seconds,
+                                seed=args.seed,
+                                pin=args.pin,
+                            )
+
+    output_file = output_dir / "workload_benchmarks.csv"
+    with open(output_file, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=WORKLOAD_FIELDS)
+        writer.writeheader()
+        for row in rows:
+            writer.writerow({**row, "pinned": int(row["pinned"])})
+
+    print(f"\nBenchmark results have been written to {output_file}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument(
+        "--suite",
+        choices=["readers", "workloads"],
+        default="readers",
+        help="readers: mutex vs atomic over reader counts, workloads: YCSB mixes",
+    )
+    parser.add_argument(
+        "--lists",
+        nargs="+",
+        default=["atomic_sw", "mutex", "atomic_mw", "sharded", "fat_node"],
+    )
+    parser.add_argument("--workloads", nargs="+", default=["A", "B", "C", "E"])
+    parser.add_argument(
+        "--distributions", nargs="+", default=["uniform", "zipfian", "latest"]
+    )
+    parser.add_argument(
+        "--keys", nargs="+", type=int, default=[10_000, 1_000_000, 100_000_000]
+    )
+    parser.add_argument("--key-types", nargs="+", default=["int", "string"])
+    parser.add_argument("--threads", nargs="+", type=int, default=[1, 4, 16])
+    parser.add_argument("--seconds", type=int, default=10)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--pin", action="store_true", help="pin threads across NUMA nodes")
+    args = parser.parse_args()
+
+    # Ensure output directory exists
+    output_dir = Path(__file__).parent / "results"
+    output_dir.mkdir(exist_ok=True)
+
+    if args.suite == "readers":
+        run_readers_suite(output_dir)
+    else:
+        run_workloads_suite(output_dir, args)
+
+
 if __name__ == "__main__":
     main()
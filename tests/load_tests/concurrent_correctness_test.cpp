@@ -10,7 +10,11 @@
 #include <memory>
 #include "skiplist.hpp"
 #include "skiplist_atomic_sw.hpp"
+#include "skiplist_atomic_mw.hpp"
 #include "skiplist_mutex.hpp"
+#include "distributed_mutex.hpp"
+#include "skiplist_sharded.hpp"
+#include "skiplist_fat_node.hpp"
 
 static constexpr size_t MAX_VALUE = 1'000'000;
 static constexpr size_t HEIGHT = 22;
@@ -226,7 +230,7 @@ int main(int argc, char **argv)
     if (argc != 4)
     {
         std::cout << "Usage: " << argv[0]
-                  << " <skiplist_type: 0=normal, 1=atomic_sw, 2=atomic_mw> "
+                  << " <skiplist_type: 0=normal, 1=atomic_sw, 2=mutex, 3=atomic_mw, 4=sharded, 6=distributed_mutex, 8=fat_node> "
                   << " <num_readers> <num_writers>" << std::endl;
         return 1;
     }
@@ -241,7 +245,8 @@ int main(int argc, char **argv)
     }
     else if (skiplist_type == 1)
     {
-        auto skiplist = create_skiplist<SkipListAtomicSingleWriter<int, int>>(HEIGHT);
+        using AtomicSkipList = SkipListAtomicSingleWriter<int, int>;
+        auto skiplist = create_skiplist<AtomicSkipList>(AtomicSkipList::heightForCapacity(MAX_VALUE));
         ConcurrentCorrectnessTest test(*skiplist, num_writers, num_readers);
         test.run();
     }
@@ -251,6 +256,34 @@ int main(int argc, char **argv)
         ConcurrentCorrectnessTest test(*skiplist, num_writers, num_readers);
         test.run();
     }
+    else if (skiplist_type == 3)
+    {
+        using AtomicSkipList = SkipListAtomicMultiWriter<int, int>;
+        auto skiplist = create_skiplist<AtomicSkipList>(AtomicSkipList::heightForCapacity(MAX_VALUE));
+        ConcurrentCorrectnessTest test(*skiplist, num_writers, num_readers);
+        test.run();
+    }
+    else if (skiplist_type == 4)
+    {
+        constexpr size_t shards = 8;
+        using Sharded = ShardedSkipList<int, int, shards>;
+        auto skiplist = create_skiplist<Sharded>(Sharded::Shard::heightForCapacity(MAX_VALUE / shards));
+        ConcurrentCorrectnessTest test(*skiplist, num_writers, num_readers);
+        test.run();
+    }
+    else if (skiplist_type == 6)
+    {
+        auto skiplist = create_skiplist<SkipListMutex<int, int, BranchingHalf, DistributedSharedMutex<>>>(HEIGHT);
+        ConcurrentCorrectnessTest test(*skiplist, num_writers, num_readers);
+        test.run();
+    }
+    else if (skiplist_type == 8)
+    {
+        using FatNodeSkipList = SkipListFatNode<int, int>;
+        auto skiplist = create_skiplist<FatNodeSkipList>(FatNodeSkipList::heightForCapacity(MAX_VALUE));
+        ConcurrentCorrectnessTest test(*skiplist, num_writers, num_readers);
+        test.run();
+    }
     else
     {
         throw std::runtime_error("Invalid skiplist type");
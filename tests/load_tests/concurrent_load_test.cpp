@@ -6,12 +6,30 @@
 #include <atomic>
 #include <iomanip>
 #include <numeric>
+#include <algorithm>
 #include <barrier>
 #include <memory>
+#include <optional>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "skiplist.hpp"
 #include "skiplist_atomic_sw.hpp"
+#include "skiplist_atomic_mw.hpp"
 #include "skiplist_mutex.hpp"
+#include "distributed_mutex.hpp"
+#include "skiplist_sharded.hpp"
+#include "skiplist_fat_node.hpp"
+#include "skiplist_replicated.hpp"
+#include "numa.hpp"
+#include "write_queue.hpp"
+#include "skiplist_stats.hpp"
+#include "latency_histogram.hpp"
 
 enum class SkipListType
 {
@@ -24,12 +42,7 @@ struct ThreadStats
 {
     size_t operations{0};
     uint64_t total_latency_ns{0};
-    std::vector<uint64_t> latencies;
-
-    ThreadStats()
-    {
-        latencies.reserve(1000000);
-    }
+    LatencyHistogram latencies;
 
     double avg_latency() const
     {
@@ -43,16 +56,80 @@ struct ThreadStats
 
     double get_percentile(double p) const
     {
-        if (latencies.empty())
-            return 0;
+        return static_cast<double>(latencies.quantile(p));
+    }
+};
+
+// Page faults and data TLB misses of the whole process over a phase of
+// the test. TLB misses come from perf_event_open, which needs
+// kernel.perf_event_paranoid <= 2 and is not counted otherwise.
+struct MemoryReport
+{
+    long minor_faults{0};
+    long major_faults{0};
+    std::optional<uint64_t> tlb_misses;
+};
 
-        size_t idx = static_cast<size_t>(p * (latencies.size() - 1));
-        return static_cast<double>(latencies[idx]);
+class MemoryCounters
+{
+private:
+    int tlb_fd{-1};
+    rusage start_usage{};
+
+public:
+    MemoryCounters()
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        // threads started later count too, and fold in when they exit
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        tlb_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
     }
 
-    void finalize()
+    MemoryCounters(const MemoryCounters &) = delete;
+    MemoryCounters &operator=(const MemoryCounters &) = delete;
+
+    ~MemoryCounters()
     {
-        std::sort(latencies.begin(), latencies.end());
+        if (tlb_fd >= 0)
+        {
+            close(tlb_fd);
+        }
+    }
+
+    void start()
+    {
+        getrusage(RUSAGE_SELF, &start_usage);
+        if (tlb_fd >= 0)
+        {
+            ioctl(tlb_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(tlb_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // call once the threads of the phase have been joined
+    MemoryReport stop()
+    {
+        MemoryReport report;
+        if (tlb_fd >= 0)
+        {
+            ioctl(tlb_fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t count = 0;
+            if (read(tlb_fd, &count, sizeof(count)) == sizeof(count))
+            {
+                report.tlb_misses = count;
+            }
+        }
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        report.minor_faults = usage.ru_minflt - start_usage.ru_minflt;
+        report.major_faults = usage.ru_majflt - start_usage.ru_majflt;
+        return report;
     }
 };
 
@@ -62,6 +139,8 @@ struct TestResults
     std::vector<ThreadStats> reader_stats;
     std::vector<ThreadStats> writer_stats;
     double duration_sec;
+    MemoryReport load_memory;
+    MemoryReport run_memory;
 
     double total_read_throughput() const
     {
@@ -88,35 +167,35 @@ struct TestResults
         return total_ops > 0 ? static_cast<double>(total_latency) / total_ops : 0;
     }
 
-    std::vector<uint64_t> get_combined_read_latencies() const
+    LatencyHistogram get_combined_read_latencies() const
     {
-        std::vector<uint64_t> combined;
-        size_t total_size = 0;
-        for (const auto &stats : reader_stats)
-        {
-            total_size += stats.latencies.size();
-        }
-        combined.reserve(total_size);
-
+        LatencyHistogram combined;
         for (const auto &stats : reader_stats)
         {
-            combined.insert(combined.end(), stats.latencies.begin(), stats.latencies.end());
+            combined += stats.latencies;
         }
-        std::sort(combined.begin(), combined.end());
         return combined;
     }
 
     double get_read_percentile(double p) const
     {
-        auto combined = get_combined_read_latencies();
-        if (combined.empty())
-            return 0;
-
-        size_t idx = static_cast<size_t>(p * (combined.size() - 1));
-        return static_cast<double>(combined[idx]);
+        return static_cast<double>(get_combined_read_latencies().quantile(p));
     }
 };
 
+void print_memory(const char *phase, const MemoryReport &report)
+{
+    std::cout << phase << report.minor_faults << " minor / " << report.major_faults << " major page faults, ";
+    if (report.tlb_misses)
+    {
+        std::cout << *report.tlb_misses << " dTLB load misses" << std::endl;
+    }
+    else
+    {
+        std::cout << "dTLB load misses not available" << std::endl;
+    }
+}
+
 void print_results(const TestResults &results)
 {
     std::cout << std::fixed << std::setprecision(2);
@@ -155,6 +234,45 @@ void print_results(const TestResults &results)
                   << "p50: " << stats.get_percentile(0.50) << " ns, "
                   << "p99: " << stats.get_percentile(0.99) << " ns" << std::endl;
     }
+
+    std::cout << "\nMemory System:" << std::endl
+              << "==============" << std::endl;
+    print_memory("Initial load: ", results.load_memory);
+    print_memory("Test run:     ", results.run_memory);
+}
+
+void print_stats(const SkipListStats &stats)
+{
+    std::cout << "\nSearch Statistics:" << std::endl
+              << "==================" << std::endl
+              << "Finds:                  " << stats.finds << std::endl
+              << "Inserts:                " << stats.inserts << std::endl
+              << "Updates:                " << stats.updates << std::endl
+              << "Update Ratio:           " << stats.updateRatio() << std::endl
+              << "Comparisons per Search: " << stats.comparisonsPerSearch() << std::endl;
+
+    std::cout << "\nLevel  Nodes Visited per Search  Tower Tops Inserted" << std::endl;
+    for (size_t level = SkipListStats::MAX_LEVELS; level-- > 0;)
+    {
+        if (stats.visits[level] == 0 && stats.towerHeights[level] == 0)
+        {
+            continue;
+        }
+        double visits = stats.searches() > 0 ? static_cast<double>(stats.visits[level]) / stats.searches() : 0;
+        std::cout << std::setw(5) << level << "  " << std::setw(24) << visits << "  "
+                  << std::setw(19) << stats.towerHeights[level] << std::endl;
+    }
+
+    if (stats.findLatency.count() + stats.upsertLatency.count() > 0)
+    {
+        std::cout << "\nOperation  p50 (ns)  p99 (ns)  p99.9 (ns)  max (ns)" << std::endl;
+        for (auto [name, latency] : {std::pair{"find  ", &stats.findLatency}, std::pair{"upsert", &stats.upsertLatency}})
+        {
+            std::cout << name << "     " << std::setw(8) << latency->quantile(0.5) << "  " << std::setw(8)
+                      << latency->quantile(0.99) << "  " << std::setw(10) << latency->quantile(0.999) << "  "
+                      << std::setw(8) << latency->max() << std::endl;
+        }
+    }
 }
 
 template <typename SkipList>
@@ -167,14 +285,25 @@ private:
     const size_t initial_size;
     const size_t num_readers;
     const size_t num_writers;
+    // empty unless threads are pinned, thread i runs on cpus[i % size]
+    const std::vector<int> cpus;
     std::unique_ptr<std::barrier<>> sync_point;
 
-    void writer_thread(ThreadStats &stats)
+    void pin(size_t thread_index)
+    {
+        if (!cpus.empty())
+        {
+            NumaTopology::pinThread({cpus[thread_index % cpus.size()]});
+        }
+    }
+
+    void writer_thread(size_t thread_index, ThreadStats &stats)
     {
         std::random_device rd;
         std::mt19937 gen(rd());
         std::uniform_int_distribution<> dis(0, 1000000);
 
+        pin(thread_index);
         sync_point->arrive_and_wait();
 
         while (running)
@@ -188,17 +317,18 @@ private:
 
             auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
             stats.total_latency_ns += latency;
-            stats.latencies.push_back(latency);
+            stats.latencies.record(latency);
             stats.operations++;
         }
     }
 
-    void reader_thread(ThreadStats &stats)
+    void reader_thread(size_t thread_index, ThreadStats &stats)
     {
         std::random_device rd;
         std::mt19937 gen(rd());
         std::uniform_int_distribution<> dis(0, 1000000);
 
+        pin(thread_index);
         sync_point->arrive_and_wait();
 
         while (running)
@@ -211,52 +341,61 @@ private:
 
             auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
             stats.total_latency_ns += latency;
-            stats.latencies.push_back(latency);
+            stats.latencies.record(latency);
             stats.operations++;
         }
     }
 
 public:
     ConcurrentTest(SkipList &sl, size_t duration_sec, size_t initial_data_size,
-                   size_t readers, size_t writers)
+                   size_t readers, size_t writers, bool pin_threads)
         : skiplist(sl),
           test_duration_sec(duration_sec),
           initial_size(initial_data_size),
           num_readers(readers),
-          num_writers(writers)
+          num_writers(writers),
+          cpus(pin_threads ? NumaTopology::interleavedCpus() : std::vector<int>{})
     {
         sync_point = std::make_unique<std::barrier<>>(readers + writers);
     }
 
     TestResults run()
     {
+        MemoryCounters counters;
         std::cout << "Initializing skiplist with " << initial_size << " elements..." << std::endl;
+        counters.start();
         for (size_t i = 0; i < initial_size; i++)
         {
             skiplist.upsert(i, i);
         }
+        MemoryReport load_memory = counters.stop();
 
         std::cout << "\nStarting concurrent test with:" << std::endl
                   << "- " << num_writers << " writer thread(s)" << std::endl
                   << "- " << num_readers << " reader thread(s)" << std::endl
                   << "- " << test_duration_sec << " seconds duration" << std::endl;
+        if (!cpus.empty())
+        {
+            std::cout << "- threads pinned across " << NumaTopology::nodes() << " NUMA node(s)" << std::endl;
+        }
 
         std::vector<ThreadStats> reader_stats(num_readers);
         std::vector<ThreadStats> writer_stats(num_writers);
         std::vector<std::thread> threads;
+        counters.start();
 
         // Start reader threads
         for (size_t i = 0; i < num_readers; i++)
         {
-            threads.emplace_back([this, &stats = reader_stats[i]]
-                                 { reader_thread(stats); });
+            threads.emplace_back([this, i, &stats = reader_stats[i]]
+                                 { reader_thread(i, stats); });
         }
 
         // Start writer threads
         for (size_t i = 0; i < num_writers; i++)
         {
-            threads.emplace_back([this, &stats = writer_stats[i]]
-                                 { writer_thread(stats); });
+            threads.emplace_back([this, i, &stats = writer_stats[i]]
+                                 { writer_thread(num_readers + i, stats); });
         }
 
         std::this_thread::sleep_for(std::chrono::seconds(test_duration_sec));
@@ -266,17 +405,38 @@ public:
         {
             thread.join();
         }
-
-        // Sort latencies for percentile calculation
-        for (auto &stats : reader_stats)
-            stats.finalize();
-        for (auto &stats : writer_stats)
-            stats.finalize();
+        MemoryReport run_memory = counters.stop();
 
         return TestResults{
             std::move(reader_stats),
             std::move(writer_stats),
-            static_cast<double>(test_duration_sec)};
+            static_cast<double>(test_duration_sec),
+            load_memory,
+            run_memory};
+    }
+};
+
+// writers enqueue into a WriteQueue, readers go straight to the list
+template <typename Stats>
+class QueuedSkipList
+{
+private:
+    using List = SkipListAtomicSingleWriter<int, int, BranchingHalf, DefaultComparator<int>, Stats>;
+
+    List list;
+    WriteQueue<int, int, List> queue;
+
+public:
+    explicit QueuedSkipList(size_t height) : list(height), queue(list) {}
+
+    void upsert(int key, int value)
+    {
+        queue.upsert(key, value);
+    }
+
+    std::optional<int> find(int key) const
+    {
+        return list.find(key);
     }
 };
 
@@ -286,15 +446,125 @@ std::unique_ptr<T> create_skiplist(size_t height)
     return std::make_unique<T>(height);
 }
 
-int main(int argc, char **argv)
+template <typename T>
+std::unique_ptr<T> create_skiplist(size_t height, const ArenaOptions &arena_options)
+{
+    return std::make_unique<T>(height, arena_options);
+}
+
+template <typename SkipList>
+void run_test(SkipList &skiplist, size_t test_duration_sec, size_t initial_size, size_t num_readers,
+              size_t num_writers, bool pin_threads)
+{
+    ConcurrentTest test(skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    auto results = test.run();
+    print_results(results);
+}
+
+// Stats is NoStats, or CountingStats to also print what the searches did
+template <typename Stats>
+void run_type(int skiplist_type, size_t num_readers, size_t num_writers, bool pin_threads,
+              const ArenaOptions &arena_options)
 {
     const size_t initial_size = 100000;
     const size_t height = 22;
+    const size_t max_keys = 1000000;
     const size_t test_duration_sec = 10;
 
-    if (argc != 4)
+    if (skiplist_type == 0)
+    {
+        throw std::runtime_error("Normal skiplist cannot handle concurrent operations");
+    }
+    else if (skiplist_type == 1)
+    {
+        using AtomicSkipList = SkipListAtomicSingleWriter<int, int, BranchingHalf, DefaultComparator<int>, Stats>;
+        auto skiplist = create_skiplist<AtomicSkipList>(AtomicSkipList::heightForCapacity(max_keys), arena_options);
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else if (skiplist_type == 2)
+    {
+        auto skiplist = create_skiplist<SkipListMutex<int, int, BranchingHalf, std::shared_mutex, Stats>>(height);
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else if (skiplist_type == 3)
+    {
+        using AtomicSkipList = SkipListAtomicMultiWriter<int, int, BranchingHalf, DefaultComparator<int>, Stats>;
+        auto skiplist = create_skiplist<AtomicSkipList>(AtomicSkipList::heightForCapacity(max_keys), arena_options);
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else if (skiplist_type == 4)
+    {
+        constexpr size_t shards = 8;
+        using Sharded = ShardedSkipList<int, int, shards, HashPartitioner<int>, BranchingHalf, DefaultComparator<int>, Stats>;
+        auto skiplist = create_skiplist<Sharded>(Sharded::Shard::heightForCapacity(max_keys / shards));
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else if (skiplist_type == 5)
+    {
+        auto skiplist = create_skiplist<QueuedSkipList<Stats>>(SkipListAtomicSingleWriter<int, int>::heightForCapacity(max_keys));
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else if (skiplist_type == 6)
     {
-        std::cout << "Usage: " << argv[0] << " <skiplist_type: 0=normal, 1=atomic> <num_readers> <num_writers>" << std::endl;
+        auto skiplist = create_skiplist<SkipListMutex<int, int, BranchingHalf, DistributedSharedMutex<>, Stats>>(height);
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else if (skiplist_type == 7)
+    {
+        using AtomicSkipList = SkipListAtomicSingleWriter<int, int, BranchingHalf, DefaultComparator<int>, Stats>;
+        auto skiplist = create_skiplist<AtomicSkipList>(AtomicSkipList::heightForCapacity(max_keys), arena_options);
+        skiplist->useFilter(max_keys);
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else if (skiplist_type == 8)
+    {
+        using FatNodeSkipList = SkipListFatNode<int, int, 16, BranchingHalf, Stats>;
+        auto skiplist = create_skiplist<FatNodeSkipList>(FatNodeSkipList::heightForCapacity(max_keys), arena_options);
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else if (skiplist_type == 9)
+    {
+        using Replicated = ReplicatedSkipList<int, int, BranchingHalf, DefaultComparator<int>, Stats>;
+        auto skiplist = create_skiplist<Replicated>(Replicated::heightForCapacity(max_keys), arena_options);
+        run_test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers, pin_threads);
+    }
+    else
+    {
+        throw std::runtime_error("Invalid skiplist type");
+    }
+
+    if constexpr (Stats::ENABLED)
+    {
+        print_stats(Stats::collect());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool stats = false;
+    bool timing = false;
+    bool pin_threads = false;
+    ArenaOptions arena_options;
+    bool valid = argc >= 4;
+    for (int i = 4; i < argc; i++)
+    {
+        std::string flag = argv[i];
+        stats |= flag == "stats";
+        timing |= flag == "timing";
+        pin_threads |= flag == "pin";
+        if (flag == "hugepages")
+        {
+            arena_options.hugePages = ArenaOptions::HugePages::Transparent;
+        }
+        if (flag == "prefault")
+        {
+            arena_options.prefault = ArenaOptions::Prefault::Background;
+        }
+        valid &= flag == "stats" || flag == "timing" || flag == "pin" || flag == "hugepages" || flag == "prefault";
+    }
+    if (!valid)
+    {
+        std::cout << "Usage: " << argv[0] << " <skiplist_type: 0=normal, 1=atomic_sw, 2=mutex, 3=atomic_mw, 4=sharded, 5=atomic_sw_queue, 6=distributed_mutex, 7=atomic_sw_filter, 8=fat_node, 9=replicated> <num_readers> <num_writers> [stats] [timing] [pin] [hugepages] [prefault]" << std::endl;
         return 1;
     }
 
@@ -302,27 +572,17 @@ int main(int argc, char **argv)
     size_t num_readers = std::stoi(argv[2]);
     size_t num_writers = std::stoi(argv[3]);
 
-    if (skiplist_type == 0)
-    {
-        throw std::runtime_error("Normal skiplist cannot handle concurrent operations");
-    }
-    else if (skiplist_type == 1)
+    if (timing)
     {
-        auto skiplist = create_skiplist<SkipListAtomicSingleWriter<int, int>>(height);
-        ConcurrentTest test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers);
-        auto results = test.run();
-        print_results(results);
+        run_type<TimingStats>(skiplist_type, num_readers, num_writers, pin_threads, arena_options);
     }
-    else if (skiplist_type == 2)
+    else if (stats)
     {
-        auto skiplist = create_skiplist<SkipListMutex<int, int>>(height);
-        ConcurrentTest test(*skiplist, test_duration_sec, initial_size, num_readers, num_writers);
-        auto results = test.run();
-        print_results(results);
+        run_type<CountingStats>(skiplist_type, num_readers, num_writers, pin_threads, arena_options);
     }
     else
     {
-        throw std::runtime_error("Invalid skiplist type");
+        run_type<NoStats>(skiplist_type, num_readers, num_writers, pin_threads, arena_options);
     }
 
     return 0;
@@ -0,0 +1,722 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <barrier>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "skiplist_atomic_sw.hpp"
+#include "skiplist_atomic_mw.hpp"
+#include "skiplist_mutex.hpp"
+#include "distributed_mutex.hpp"
+#include "skiplist_sharded.hpp"
+#include "skiplist_fat_node.hpp"
+#include "skiplist_replicated.hpp"
+#include "numa.hpp"
+#include "latency_histogram.hpp"
+
+// YCSB style workloads against the skip lists. Every thread runs the same
+// operation mix on keys drawn from the chosen distribution, seeded per
+// thread, and the results are printed as CSV or JSON for scripts/benchmark.py.
+//
+// Lists with a single writer get their writes serialized by a mutex, so
+// every mix runs on every list; their reads stay lock-free.
+
+namespace
+{
+
+const char *USAGE =
+    "Usage: workload_benchmark [--list=atomic_sw] [--workload=A|B|C|E] "
+    "[--distribution=uniform|zipfian|sequential|latest] [--keys=100000] "
+    "[--key-type=int|string] [--threads=4] [--seconds=10] [--ops=N] [--interval=S] [--seed=1] "
+    "[--theta=0.99] [--pin] [--format=csv|json]\n"
+    "lists: atomic_sw, atomic_sw_filter, mutex, distributed_mutex, atomic_mw, sharded, fat_node, replicated\n"
+    "string keys: atomic_sw, atomic_sw_filter, mutex, sharded";
+
+enum class Distribution
+{
+    Uniform,
+    Zipfian,
+    Sequential,
+    Latest
+};
+
+enum Operation
+{
+    READ,
+    UPDATE,
+    INSERT,
+    SCAN,
+    OPERATIONS
+};
+
+const char *OPERATION_NAMES[OPERATIONS] = {"read", "update", "insert", "scan"};
+
+struct Config
+{
+    std::string list = "atomic_sw";
+    char workload = 'A';
+    std::string distribution = "zipfian";
+    uint64_t keys = 100000;
+    std::string key_type = "int";
+    size_t threads = 4;
+    size_t seconds = 10;
+    // operations per thread, 0 runs for seconds instead
+    uint64_t ops = 0;
+    // seconds between progress reports on stderr, 0 for none
+    size_t interval = 0;
+    uint64_t seed = 1;
+    double theta = 0.99;
+    bool pin = false;
+    std::string format = "csv";
+};
+
+// the YCSB core workloads, as fractions of all operations
+struct Mix
+{
+    double fractions[OPERATIONS];
+    // scans cover 1 to max_scan_length records, uniformly
+    size_t max_scan_length = 100;
+};
+
+Mix mix_of(char workload)
+{
+    switch (workload)
+    {
+    case 'A':
+        return {{0.5, 0.5, 0, 0}};
+    case 'B':
+        return {{0.95, 0.05, 0, 0}};
+    case 'C':
+        return {{1, 0, 0, 0}};
+    case 'E':
+        return {{0, 0, 0.05, 0.95}};
+    default:
+        throw std::invalid_argument(std::string("unknown workload ") + workload);
+    }
+}
+
+Distribution distribution_of(const std::string &name)
+{
+    static const std::map<std::string, Distribution> names = {{"uniform", Distribution::Uniform},
+                                                              {"zipfian", Distribution::Zipfian},
+                                                              {"sequential", Distribution::Sequential},
+                                                              {"latest", Distribution::Latest}};
+    auto found = names.find(name);
+    if (found == names.end())
+    {
+        throw std::invalid_argument("unknown distribution " + name);
+    }
+    return found->second;
+}
+
+// Zipfian ranks in [0, items), 0 the most popular, after Gray et al.,
+// "Quickly generating billion-record synthetic databases", as in YCSB.
+class Zipfian
+{
+private:
+    uint64_t items;
+    double theta;
+    double alpha;
+    double zeta_n;
+    double eta;
+
+public:
+    Zipfian(uint64_t items, double theta) : items(items), theta(theta), alpha(1 / (1 - theta)), zeta_n(0)
+    {
+        for (uint64_t i = 1; i <= items; i++)
+        {
+            zeta_n += 1 / std::pow(static_cast<double>(i), theta);
+        }
+        double zeta2 = 1 + std::pow(0.5, theta);
+        eta = (1 - std::pow(2.0 / static_cast<double>(items), 1 - theta)) / (1 - zeta2 / zeta_n);
+    }
+
+    // u uniform in [0, 1)
+    uint64_t operator()(double u) const
+    {
+        double uz = u * zeta_n;
+        if (uz < 1)
+        {
+            return 0;
+        }
+        if (uz < 1 + std::pow(0.5, theta))
+        {
+            return 1;
+        }
+        auto rank = static_cast<uint64_t>(static_cast<double>(items) * std::pow(eta * u - eta + 1, alpha));
+        return std::min(rank, items - 1);
+    }
+};
+
+uint64_t fnv1a(uint64_t value)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; i++)
+    {
+        hash ^= value & 0xff;
+        hash *= 0x100000001b3ULL;
+        value >>= 8;
+    }
+    return hash;
+}
+
+// Picks the record index of the next operation. Zipfian ranks are
+// scattered over the records by a hash, otherwise the hot keys would all
+// sit at the start of the list. Latest favours the records inserted last.
+class KeyChooser
+{
+private:
+    Distribution distribution;
+    const Zipfian *zipfian;
+    const std::atomic<uint64_t> &records;
+    uint64_t next;
+
+public:
+    KeyChooser(Distribution distribution, const Zipfian *zipfian, const std::atomic<uint64_t> &records,
+               uint64_t start)
+        : distribution(distribution), zipfian(zipfian), records(records), next(start)
+    {
+    }
+
+    uint64_t operator()(std::mt19937_64 &gen)
+    {
+        uint64_t count = records.load(std::memory_order_relaxed);
+        double u = std::uniform_real_distribution<>(0, 1)(gen);
+        switch (distribution)
+        {
+        case Distribution::Uniform:
+            return std::min(static_cast<uint64_t>(u * static_cast<double>(count)), count - 1);
+        case Distribution::Zipfian:
+            return fnv1a((*zipfian)(u)) % count;
+        case Distribution::Sequential:
+            return next++ % count;
+        case Distribution::Latest:
+            return count - 1 - std::min((*zipfian)(u), count - 1);
+        }
+        return 0;
+    }
+};
+
+// keys are the record index; string keys spell it out in decimal behind a
+// common prefix, like YCSB's "user" keys, so they sort like the index
+struct IntKeys
+{
+    using Key = uint64_t;
+    using Buffer = std::array<char, 0>;
+
+    static Key make(uint64_t record, Buffer &)
+    {
+        return record;
+    }
+};
+
+struct StringKeys
+{
+    using Key = std::string_view;
+    static constexpr size_t DIGITS = 12;
+    using Buffer = std::array<char, 4 + DIGITS>;
+
+    static Key make(uint64_t record, Buffer &buffer)
+    {
+        buffer.fill('0');
+        std::copy_n("user", 4, buffer.begin());
+        char digits[20];
+        auto end = std::to_chars(digits, digits + sizeof(digits), record).ptr;
+        std::copy(digits, end, buffer.end() - (end - digits));
+        return {buffer.data(), buffer.size()};
+    }
+};
+
+struct ThreadResult
+{
+    LatencyHistogram latencies[OPERATIONS];
+};
+
+struct OperationResult
+{
+    const char *operation;
+    uint64_t count;
+    double throughput;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+void print_progress(double seconds, const std::vector<OperationResult> &results)
+{
+    std::cerr << std::fixed << std::setprecision(1) << "after " << seconds << " s:";
+    for (const auto &r : results)
+    {
+        std::cerr << ' ' << r.operation << ' ' << r.throughput << " ops/s p50 " << r.p50 << " p99 " << r.p99
+                  << " p99.9 " << r.p999 << " ns;";
+    }
+    std::cerr << std::endl;
+}
+
+// ListKey is the key type of the list, list_key() converts generated keys
+// to it where they differ, such as std::string lists fed string views
+template <typename List, typename Keys, typename ListKey = typename Keys::Key>
+class WorkloadRunner
+{
+private:
+    List &list;
+    const Config &config;
+    const Mix mix;
+    const bool single_writer;
+    std::mutex write_mutex;
+    std::atomic<uint64_t> records;
+    std::atomic<bool> running{true};
+
+    static ListKey list_key(typename Keys::Key key)
+    {
+        return ListKey(key);
+    }
+
+    template <typename Target>
+    static const auto &ordered_view(const Target &target)
+    {
+        if constexpr (requires { target.local(); })
+        {
+            return target.local();
+        }
+        else
+        {
+            return target;
+        }
+    }
+
+    void write(uint64_t record, uint64_t value)
+    {
+        typename Keys::Buffer buffer;
+        ListKey key = list_key(Keys::make(record, buffer));
+        if (single_writer)
+        {
+            std::lock_guard<std::mutex> lock(write_mutex);
+            list.upsert(key, value);
+        }
+        else
+        {
+            list.upsert(key, value);
+        }
+    }
+
+    void read(uint64_t record)
+    {
+        typename Keys::Buffer buffer;
+        auto found = list.find(list_key(Keys::make(record, buffer)));
+        volatile bool sink = found.has_value();
+        (void)sink;
+    }
+
+    static constexpr bool CAN_SCAN = requires(const List &l, const ListKey &k) { ordered_view(l).seek(k); };
+
+    void scan(uint64_t record, size_t length)
+    {
+        if constexpr (CAN_SCAN)
+        {
+            typename Keys::Buffer buffer;
+            const auto &ordered = ordered_view(list);
+            auto it = ordered.seek(list_key(Keys::make(record, buffer)));
+            uint64_t sum = 0;
+            for (size_t i = 0; i < length && it != ordered.end(); i++, ++it)
+            {
+                sum += it.value();
+            }
+            volatile uint64_t sink = sum;
+            (void)sink;
+        }
+        else
+        {
+            (void)record;
+            (void)length;
+        }
+    }
+
+    void worker(size_t index, const Zipfian *zipfian, std::barrier<> &start, ThreadResult &result)
+    {
+        if (config.pin)
+        {
+            std::vector<int> cpus = NumaTopology::interleavedCpus();
+            NumaTopology::pinThread({cpus[index % cpus.size()]});
+        }
+        std::mt19937_64 gen(config.seed * 1000003 + index);
+        KeyChooser choose(distribution_of(config.distribution), zipfian, records,
+                          config.keys / config.threads * index);
+        std::uniform_real_distribution<> pick(0, 1);
+        std::uniform_int_distribution<size_t> scan_length(1, mix.max_scan_length);
+        start.arrive_and_wait();
+
+        for (uint64_t done = 0; config.ops ? done < config.ops : running.load(std::memory_order_relaxed); done++)
+        {
+            double u = pick(gen);
+            int operation = 0;
+            while (operation < OPERATIONS - 1 && u >= mix.fractions[operation])
+            {
+                u -= mix.fractions[operation];
+                operation++;
+            }
+
+            auto begin = std::chrono::steady_clock::now();
+            switch (operation)
+            {
+            case READ:
+                read(choose(gen));
+                break;
+            case UPDATE:
+                write(choose(gen), gen());
+                break;
+            case INSERT:
+                write(records.fetch_add(1, std::memory_order_relaxed), gen());
+                break;
+            case SCAN:
+                scan(choose(gen), scan_length(gen));
+                break;
+            }
+            auto end = std::chrono::steady_clock::now();
+            auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+            result.latencies[operation].record(static_cast<uint64_t>(latency));
+        }
+    }
+
+public:
+    WorkloadRunner(List &list, const Config &config, bool single_writer)
+        : list(list), config(config), mix(mix_of(config.workload)), single_writer(single_writer),
+          records(config.keys)
+    {
+        if (mix.fractions[SCAN] > 0 && !CAN_SCAN)
+        {
+            throw std::invalid_argument("list " + config.list + " cannot scan");
+        }
+    }
+
+    void load()
+    {
+        constexpr uint64_t BATCH = 1 << 16;
+        std::vector<typename Keys::Buffer> buffers(BATCH);
+        std::vector<std::pair<ListKey, uint64_t>> batch;
+        for (uint64_t first = 0; first < config.keys; first += BATCH)
+        {
+            batch.clear();
+            for (uint64_t record = first; record < std::min(config.keys, first + BATCH); record++)
+            {
+                batch.emplace_back(list_key(Keys::make(record, buffers[record - first])), record);
+            }
+            if constexpr (requires { list.upsertBatch(batch.begin(), batch.end()); })
+            {
+                list.upsertBatch(batch.begin(), batch.end());
+            }
+            else
+            {
+                for (const auto &[key, value] : batch)
+                {
+                    list.upsert(key, value);
+                }
+            }
+        }
+    }
+
+    std::vector<OperationResult> run()
+    {
+        std::unique_ptr<Zipfian> zipfian;
+        Distribution distribution = distribution_of(config.distribution);
+        if (distribution == Distribution::Zipfian || distribution == Distribution::Latest)
+        {
+            zipfian = std::make_unique<Zipfian>(config.keys, config.theta);
+        }
+
+        std::vector<ThreadResult> results(config.threads);
+        std::barrier<> start(static_cast<std::ptrdiff_t>(config.threads + 1));
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < config.threads; i++)
+        {
+            threads.emplace_back([&, i] { worker(i, zipfian.get(), start, results[i]); });
+        }
+
+        start.arrive_and_wait();
+        auto begin = std::chrono::steady_clock::now();
+        auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); };
+        if (!config.ops)
+        {
+            auto stop = begin + std::chrono::seconds(config.seconds);
+            auto interval = config.interval ? std::chrono::seconds(config.interval) : std::chrono::seconds(config.seconds);
+            for (auto next = begin + interval; next < stop; next += interval)
+            {
+                std::this_thread::sleep_until(next);
+                print_progress(elapsed(), summarize(results, elapsed()));
+            }
+            std::this_thread::sleep_until(stop);
+            running = false;
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        return summarize(results, elapsed());
+    }
+
+    // latencies since the start, safe while the workers record
+    static std::vector<OperationResult> summarize(const std::vector<ThreadResult> &results, double seconds)
+    {
+        std::vector<OperationResult> summary;
+        for (int operation = 0; operation < OPERATIONS; operation++)
+        {
+            LatencyHistogram all;
+            for (const auto &result : results)
+            {
+                all += result.latencies[operation];
+            }
+            if (all.count() == 0)
+            {
+                continue;
+            }
+            summary.push_back({OPERATION_NAMES[operation], all.count(), all.count() / seconds, all.quantile(0.5),
+                               all.quantile(0.9), all.quantile(0.99), all.quantile(0.999), all.max()});
+        }
+        return summary;
+    }
+};
+
+void print_results(const Config &config, const std::vector<OperationResult> &results)
+{
+    std::cout << std::fixed << std::setprecision(1);
+    if (config.format == "json")
+    {
+        std::cout << "{\"list\": \"" << config.list << "\", \"workload\": \"" << config.workload
+                  << "\", \"distribution\": \"" << config.distribution << "\", \"keys\": " << config.keys
+                  << ", \"key_type\": \"" << config.key_type << "\", \"threads\": " << config.threads
+                  << ", \"pinned\": " << (config.pin ? "true" : "false") << ", \"seed\": " << config.seed
+                  << ", \"operations\": [";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const auto &r = results[i];
+            std::cout << (i ? ", " : "") << "{\"operation\": \"" << r.operation << "\", \"count\": " << r.count
+                      << ", \"throughput\": " << r.throughput << ", \"p50_ns\": " << r.p50
+                      << ", \"p90_ns\": " << r.p90 << ", \"p99_ns\": " << r.p99 << ", \"p999_ns\": " << r.p999
+                      << ", \"max_ns\": " << r.max << "}";
+        }
+        std::cout << "]}" << std::endl;
+        return;
+    }
+
+    std::cout << "list,workload,distribution,keys,key_type,threads,pinned,seed,operation,count,throughput,"
+                 "p50_ns,p90_ns,p99_ns,p999_ns,max_ns"
+              << std::endl;
+    for (const auto &r : results)
+    {
+        std::cout << config.list << ',' << config.workload << ',' << config.distribution << ',' << config.keys
+                  << ',' << config.key_type << ',' << config.threads << ',' << config.pin << ',' << config.seed
+                  << ',' << r.operation << ',' << r.count << ',' << r.throughput << ',' << r.p50 << ','
+                  << r.p90 << ',' << r.p99 << ',' << r.p999 << ',' << r.max << std::endl;
+    }
+}
+
+template <typename Keys, typename ListKey = typename Keys::Key, typename List>
+void benchmark(List &list, const Config &config, bool single_writer)
+{
+    WorkloadRunner<List, Keys, ListKey> runner(list, config, single_writer);
+    std::cerr << "loading " << config.keys << " keys into " << config.list << std::endl;
+    runner.load();
+    std::cerr << "running workload " << config.workload << std::endl;
+    print_results(config, runner.run());
+}
+
+template <typename Keys>
+bool run_int_only(const Config &config)
+{
+    if constexpr (std::is_same_v<Keys, IntKeys>)
+    {
+        using Key = IntKeys::Key;
+        if (config.list == "atomic_mw")
+        {
+            using List = SkipListAtomicMultiWriter<Key, uint64_t>;
+            auto list = std::make_unique<List>(List::heightForCapacity(config.keys * 2));
+            benchmark<Keys>(*list, config, false);
+            return true;
+        }
+        if (config.list == "fat_node")
+        {
+            using List = SkipListFatNode<Key, uint64_t>;
+            auto list = std::make_unique<List>(List::heightForCapacity(config.keys * 2));
+            benchmark<Keys>(*list, config, true);
+            return true;
+        }
+        if (config.list == "replicated")
+        {
+            using List = ReplicatedSkipList<Key, uint64_t>;
+            auto list = std::make_unique<List>(List::heightForCapacity(config.keys * 2));
+            benchmark<Keys>(*list, config, true);
+            return true;
+        }
+        if (config.list == "distributed_mutex")
+        {
+            using List = SkipListMutex<Key, uint64_t, BranchingHalf, DistributedSharedMutex<>>;
+            auto list = std::make_unique<List>(List::MAX_HEIGHT);
+            benchmark<Keys>(*list, config, false);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Key is the key type of lists that copy keys, OwnedKey of lists storing
+// them as they are
+template <typename Keys, typename OwnedKey>
+void run(const Config &config)
+{
+    using Key = typename Keys::Key;
+    if (config.list == "atomic_sw" || config.list == "atomic_sw_filter")
+    {
+        using List = SkipListAtomicSingleWriter<Key, uint64_t>;
+        auto list = std::make_unique<List>(List::heightForCapacity(config.keys * 2));
+        if (config.list == "atomic_sw_filter")
+        {
+            list->useFilter(config.keys * 2);
+        }
+        benchmark<Keys>(*list, config, true);
+    }
+    else if (config.list == "mutex")
+    {
+        using List = SkipListMutex<OwnedKey, uint64_t>;
+        auto list = std::make_unique<List>(List::MAX_HEIGHT);
+        benchmark<Keys, OwnedKey>(*list, config, false);
+    }
+    else if (config.list == "sharded")
+    {
+        constexpr size_t shards = 8;
+        using List = ShardedSkipList<Key, uint64_t, shards>;
+        auto list = std::make_unique<List>(List::Shard::heightForCapacity(config.keys * 2 / shards));
+        benchmark<Keys>(*list, config, false);
+    }
+    else if (!run_int_only<Keys>(config))
+    {
+        throw std::invalid_argument("unknown list " + config.list + " for " + config.key_type + " keys");
+    }
+}
+
+Config parse_arguments(int argc, char **argv)
+{
+    Config config;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        size_t equals = argument.find('=');
+        std::string name = argument.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+        if (name == "--pin")
+        {
+            config.pin = true;
+        }
+        else if (value.empty())
+        {
+            throw std::invalid_argument("missing value for " + argument);
+        }
+        else if (name == "--list")
+        {
+            config.list = value;
+        }
+        else if (name == "--workload")
+        {
+            config.workload = value[0];
+            mix_of(config.workload);
+        }
+        else if (name == "--distribution")
+        {
+            config.distribution = value;
+            distribution_of(value);
+        }
+        else if (name == "--keys")
+        {
+            config.keys = std::stoull(value);
+        }
+        else if (name == "--key-type")
+        {
+            config.key_type = value;
+        }
+        else if (name == "--threads")
+        {
+            config.threads = std::stoul(value);
+        }
+        else if (name == "--seconds")
+        {
+            config.seconds = std::stoul(value);
+        }
+        else if (name == "--interval")
+        {
+            config.interval = std::stoul(value);
+        }
+        else if (name == "--ops")
+        {
+            config.ops = std::stoull(value);
+        }
+        else if (name == "--seed")
+        {
+            config.seed = std::stoull(value);
+        }
+        else if (name == "--theta")
+        {
+            config.theta = std::stod(value);
+        }
+        else if (name == "--format")
+        {
+            config.format = value;
+        }
+        else
+        {
+            throw std::invalid_argument("unknown option " + argument);
+        }
+    }
+    if (config.keys == 0 || config.threads == 0)
+    {
+        throw std::invalid_argument("keys and threads must be positive");
+    }
+    if (config.key_type != "int" && config.key_type != "string")
+    {
+        throw std::invalid_argument("unknown key type " + config.key_type);
+    }
+    if (config.format != "csv" && config.format != "json")
+    {
+        throw std::invalid_argument("unknown format " + config.format);
+    }
+    return config;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        Config config = parse_arguments(argc, argv);
+        if (config.key_type == "int")
+        {
+            run<IntKeys, uint64_t>(config);
+        }
+        else
+        {
+            run<StringKeys, std::string>(config);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl
+                  << USAGE << std::endl;
+        return 1;
+    }
+    return 0;
+}
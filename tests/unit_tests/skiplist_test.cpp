@@ -1,10 +1,26 @@
 #include <gtest/gtest.h>
 #include "skiplist.hpp"
 #include "skiplist_atomic_sw.hpp"
+#include "skiplist_atomic_mw.hpp"
 #include "skiplist_mutex.hpp"
+#include "skiplist_versioned.hpp"
+#include "skiplist_sharded.hpp"
+#include "write_queue.hpp"
+#include "distributed_mutex.hpp"
+#include "skiplist_file.hpp"
+#include "memtable_set.hpp"
+#include "skiplist_fat_node.hpp"
+#include "skiplist_replicated.hpp"
+#include "numa.hpp"
 #include <random>
 #include <algorithm>
 #include <memory>
+#include <map>
+#include <thread>
+#include <latch>
+#include <ranges>
+#include <filesystem>
+#include <fstream>
 
 template <typename T>
 class SkipListTestFixture : public ::testing::Test
@@ -22,7 +38,15 @@ protected:
 using SkipListTypes = ::testing::Types<
     SkipList<int, int>,
     SkipListAtomicSingleWriter<int, int>,
-    SkipListMutex<int, int>>;
+    SkipListMutex<int, int>,
+    SkipListMutex<int, int, BranchingHalf, DistributedSharedMutex<>>,
+    SkipList<int, int, BranchingInverseE>,
+    SkipListAtomicSingleWriter<int, int, BranchingQuarter>,
+    SkipListAtomicMultiWriter<int, int>,
+    ShardedSkipList<int, int, 4>,
+    SkipListFatNode<int, int>,
+    SkipListFatNode<int, int, 4>,
+    BasicSkipList<int, int, Locked<>, Arena, std::greater<int>, 8>>;
 
 TYPED_TEST_SUITE(SkipListTestFixture, SkipListTypes);
 
@@ -166,3 +190,2116 @@ TYPED_TEST(SkipListTestFixture, MixedOperations)
     EXPECT_EQ(*(this->sl->find(4)), 40);
     EXPECT_EQ(*(this->sl->find(5)), 50);
 }
+
+TEST(SkipListAtomicSingleWriterTest, MemoryUsageTracksArena)
+{
+    SkipListAtomicSingleWriter<int, int> sl(5, 4096);
+    size_t initialUsage = sl.memoryUsage();
+    EXPECT_GT(initialUsage, 0u);
+
+    for (int i = 0; i < 10000; i++)
+    {
+        sl.upsert(i, i);
+    }
+    EXPECT_GE(sl.memoryUsage(), initialUsage + 10000 * (SkipListAtomicSingleWriter<int, int>::getNodeSize()));
+
+    sl.clear();
+    EXPECT_EQ(sl.memoryUsage(), 0u);
+}
+
+TEST(ArenaTest, AllocationsAreAlignedAndDisjoint)
+{
+    Arena arena(1024);
+    std::vector<std::pair<char *, size_t>> allocations;
+    for (size_t i = 1; i < 500; i++)
+    {
+        size_t alignment = size_t(1) << (i % 5);
+        auto ptr = static_cast<char *>(arena.allocate(i % 97 + 1, alignment));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0u);
+        allocations.emplace_back(ptr, i % 97 + 1);
+    }
+    std::sort(allocations.begin(), allocations.end());
+    for (size_t i = 1; i < allocations.size(); i++)
+    {
+        EXPECT_LE(allocations[i - 1].first + allocations[i - 1].second, allocations[i].first);
+    }
+
+    // oversized requests get a dedicated block
+    size_t blocksBefore = arena.blockCount();
+    arena.allocate(4096);
+    EXPECT_EQ(arena.blockCount(), blocksBefore + 1);
+
+    arena.release();
+    EXPECT_EQ(arena.memoryUsage(), 0u);
+    EXPECT_EQ(arena.blockCount(), 0u);
+}
+
+TEST(SkipListAtomicSingleWriterTest, HeightBounds)
+{
+    using SL = SkipListAtomicSingleWriter<int, int>;
+    EXPECT_THROW(SL(0), std::invalid_argument);
+    EXPECT_THROW(SL(SL::MAX_HEIGHT + 1), std::invalid_argument);
+
+    SL flat(1);
+    SL tall(SL::MAX_HEIGHT);
+    for (int i = 0; i < 1000; i++)
+    {
+        flat.upsert(i, i);
+        tall.upsert(i, i);
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        EXPECT_EQ(*flat.find(i), i);
+        EXPECT_EQ(*tall.find(i), i);
+    }
+}
+
+static_assert(std::forward_iterator<SkipListAtomicSingleWriter<int, int>::Iterator>);
+
+TEST(SkipListAtomicSingleWriterTest, IteratesInOrder)
+{
+    SkipListAtomicSingleWriter<int, int> sl(5);
+    EXPECT_TRUE(sl.begin() == sl.end());
+
+    std::vector<int> numbers(1000);
+    std::iota(numbers.begin(), numbers.end(), 0);
+    std::mt19937 g(42);
+    std::shuffle(numbers.begin(), numbers.end(), g);
+    for (int num : numbers)
+    {
+        sl.upsert(num * 2, num);
+    }
+
+    int expected = 0;
+    for (auto [key, value] : sl)
+    {
+        EXPECT_EQ(key, expected * 2);
+        EXPECT_EQ(value, expected);
+        expected++;
+    }
+    EXPECT_EQ(expected, 1000);
+}
+
+TEST(SkipListAtomicSingleWriterTest, Seek)
+{
+    SkipListAtomicSingleWriter<int, int> sl(5);
+    for (int i = 0; i < 100; i += 10)
+    {
+        sl.upsert(i, i);
+    }
+
+    EXPECT_EQ(sl.seek(-5).key(), 0);
+    EXPECT_EQ(sl.seek(0).key(), 0);
+    EXPECT_EQ(sl.seek(1).key(), 10);
+    EXPECT_EQ(sl.seek(90).key(), 90);
+    EXPECT_TRUE(sl.seek(91) == sl.end());
+
+    auto it = sl.seek(35);
+    EXPECT_EQ((*it++).first, 40);
+    EXPECT_EQ(it.key(), 50);
+    EXPECT_EQ(it.value(), 50);
+}
+
+TEST(SkipListAtomicSingleWriterTest, Scan)
+{
+    SkipListAtomicSingleWriter<int, int> sl(5);
+    for (int i = 0; i < 100; i++)
+    {
+        sl.upsert(i, i * 2);
+    }
+
+    std::vector<std::pair<int, int>> scanned;
+    sl.scan(10, 20, [&](int key, int value)
+            { scanned.emplace_back(key, value); });
+    ASSERT_EQ(scanned.size(), 10u);
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_EQ(scanned[i], std::make_pair(10 + i, (10 + i) * 2));
+    }
+
+    scanned.clear();
+    sl.scan(95, 1000, [&](int key, int value)
+            { scanned.emplace_back(key, value); });
+    EXPECT_EQ(scanned.size(), 5u);
+
+    scanned.clear();
+    sl.scan(50, 50, [&](int key, int value)
+            { scanned.emplace_back(key, value); });
+    EXPECT_TRUE(scanned.empty());
+}
+
+template <typename Branching>
+void expectGeometricHeights()
+{
+    constexpr size_t SAMPLES = 200000;
+    constexpr size_t MAX_HEIGHT = 32;
+    TowerHeightGenerator<Branching> generator(7);
+    std::vector<size_t> histogram(MAX_HEIGHT + 1);
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        size_t height = generator.next(MAX_HEIGHT);
+        ASSERT_GE(height, 1u);
+        ASSERT_LE(height, MAX_HEIGHT);
+        histogram[height]++;
+    }
+
+    // P(height >= h + 1) = p^h
+    double p = TowerHeightGenerator<Branching>::probability();
+    size_t atLeast = SAMPLES;
+    double expected = SAMPLES;
+    for (size_t h = 1; h <= 4; h++)
+    {
+        EXPECT_NEAR(static_cast<double>(atLeast) / SAMPLES, expected / SAMPLES, 0.01) << "height " << h;
+        atLeast -= histogram[h];
+        expected *= p;
+    }
+}
+
+TEST(TowerHeightGeneratorTest, GeometricDistribution)
+{
+    expectGeometricHeights<BranchingHalf>();
+    expectGeometricHeights<BranchingQuarter>();
+    expectGeometricHeights<BranchingInverseE>();
+}
+
+TEST(TowerHeightGeneratorTest, RespectsMaxHeight)
+{
+    TowerHeightGenerator<BranchingHalf> generator;
+    for (int i = 0; i < 10000; i++)
+    {
+        EXPECT_EQ(generator.next(1), 1u);
+        EXPECT_LE(generator.next(3), 3u);
+    }
+}
+
+TEST(SkipListAtomicSingleWriterTest, HeightGrowsWithContent)
+{
+    using SL = SkipListAtomicSingleWriter<int, int>;
+    SL sl(SL::MAX_HEIGHT);
+    EXPECT_EQ(sl.getHeight(), 1u);
+    EXPECT_FALSE(sl.find(1).has_value());
+
+    for (int i = 0; i < 100000; i++)
+    {
+        sl.upsert(i, i);
+    }
+    EXPECT_GT(sl.getHeight(), 10u);
+    EXPECT_LT(sl.getHeight(), 30u);
+    for (int i = 0; i < 100000; i += 7)
+    {
+        EXPECT_EQ(*sl.find(i), i);
+    }
+}
+
+TEST(SkipListAtomicSingleWriterTest, HeightForCapacity)
+{
+    using SL = SkipListAtomicSingleWriter<int, int>;
+    EXPECT_EQ(SL::heightForCapacity(0), 2u);
+    EXPECT_EQ(SL::heightForCapacity(1024), 11u);
+    EXPECT_EQ(SL::heightForCapacity(1000000), 21u);
+    EXPECT_EQ(SL::heightForCapacity(SIZE_MAX), SL::MAX_HEIGHT);
+    EXPECT_EQ((SkipListAtomicSingleWriter<int, int, BranchingQuarter>::heightForCapacity(1 << 20)), 11u);
+}
+
+TEST(SkipListAtomicMultiWriterTest, ConcurrentWriters)
+{
+    constexpr int WRITERS = 4;
+    constexpr int KEYS = 20000;
+    SkipListAtomicMultiWriter<int, int> sl(SkipListAtomicMultiWriter<int, int>::heightForCapacity(KEYS));
+
+    // every writer inserts all keys, the value identifies the key only
+    std::vector<std::thread> threads;
+    for (int t = 0; t < WRITERS; t++)
+    {
+        threads.emplace_back([&sl, t]
+                             {
+            std::vector<int> keys(KEYS);
+            std::iota(keys.begin(), keys.end(), 0);
+            std::mt19937 g(t);
+            std::shuffle(keys.begin(), keys.end(), g);
+            for (int key : keys)
+            {
+                sl.upsert(key, key * 2);
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    for (int i = 0; i < KEYS; i++)
+    {
+        ASSERT_EQ(*sl.find(i), i * 2);
+    }
+    EXPECT_FALSE(sl.find(KEYS).has_value());
+}
+
+TEST(SkipListAtomicMultiWriterTest, UpdatesDoNotRaiseHeight)
+{
+    SkipListAtomicMultiWriter<int, int> sl(8);
+    sl.upsert(0, 0);
+    size_t height = sl.getHeight();
+    for (int i = 1; i < 10000; i++)
+    {
+        sl.upsert(0, i);
+    }
+    EXPECT_EQ(sl.getHeight(), height);
+    EXPECT_EQ(*sl.find(0), 9999);
+}
+
+// a key offering no operators, the list must only use its comparator
+struct OpaqueKey
+{
+    int id;
+};
+
+struct OpaqueKeyDescending
+{
+    bool operator()(const OpaqueKey &a, const OpaqueKey &b) const
+    {
+        return a.id > b.id;
+    }
+};
+
+TEST(SkipListAtomicMultiWriterTest, CustomComparator)
+{
+    SkipListAtomicMultiWriter<OpaqueKey, int, BranchingHalf, OpaqueKeyDescending> sl(8);
+    for (int i = 0; i < 500; i++)
+    {
+        sl.upsert({i}, i);
+    }
+    for (int i = 0; i < 500; i += 2)
+    {
+        sl.upsert({i}, -i);
+    }
+    for (int i = 0; i < 500; i++)
+    {
+        ASSERT_EQ(*sl.find({i}), i % 2 == 0 ? -i : i);
+    }
+    EXPECT_FALSE(sl.find({-1}).has_value());
+    EXPECT_FALSE(sl.find({500}).has_value());
+}
+
+TEST(ConcurrentArenaTest, ConcurrentAllocationsAreDisjoint)
+{
+    ConcurrentArena arena(4096);
+    constexpr int THREADS = 4;
+    constexpr int ALLOCATIONS = 10000;
+    std::vector<std::vector<std::pair<char *, size_t>>> allocations(THREADS);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back([&, t]
+                             {
+            for (int i = 0; i < ALLOCATIONS; i++)
+            {
+                size_t bytes = (i % 64) + 1;
+                auto ptr = static_cast<char *>(arena.allocate(bytes, 8));
+                allocations[t].emplace_back(ptr, bytes);
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    std::vector<std::pair<char *, size_t>> all;
+    for (auto &perThread : allocations)
+    {
+        all.insert(all.end(), perThread.begin(), perThread.end());
+    }
+    std::sort(all.begin(), all.end());
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(all[i].first) % 8, 0u);
+        if (i > 0)
+        {
+            EXPECT_LE(all[i - 1].first + all[i - 1].second, all[i].first);
+        }
+    }
+}
+
+TEST(SkipListAtomicSingleWriterTest, UpsertBatchSorted)
+{
+    SkipListAtomicSingleWriter<int, int> sl(SkipListAtomicSingleWriter<int, int>::heightForCapacity(10000));
+    sl.upsert(5000, -1);
+
+    std::vector<std::pair<int, int>> batch;
+    for (int i = 0; i < 10000; i++)
+    {
+        batch.emplace_back(i, i * 2);
+    }
+    sl.upsertBatch(batch.begin(), batch.end());
+
+    int expected = 0;
+    for (auto [key, value] : sl)
+    {
+        ASSERT_EQ(key, expected);
+        ASSERT_EQ(value, expected * 2);
+        expected++;
+    }
+    EXPECT_EQ(expected, 10000);
+}
+
+TEST(SkipListAtomicSingleWriterTest, UpsertBatchUnsortedWithDuplicates)
+{
+    SkipListAtomicSingleWriter<int, int> sl(10);
+    for (int i = 0; i < 100; i += 2)
+    {
+        sl.upsert(i, -i);
+    }
+
+    std::vector<std::pair<int, int>> batch;
+    for (int i = 0; i < 100; i++)
+    {
+        batch.emplace_back(i, i);
+    }
+    std::mt19937 g(3);
+    std::shuffle(batch.begin(), batch.end(), g);
+    // the later duplicate wins
+    batch.emplace_back(10, 1000);
+    sl.upsertBatch(batch.begin(), batch.end());
+
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(*sl.find(i), i == 10 ? 1000 : i);
+    }
+    EXPECT_EQ(std::distance(sl.begin(), sl.end()), 100);
+
+    std::vector<std::pair<int, int>> empty;
+    sl.upsertBatch(empty.begin(), empty.end());
+    EXPECT_EQ(std::distance(sl.begin(), sl.end()), 100);
+}
+
+TEST(SkipListAtomicSingleWriterTest, UpsertBatchFromByValueIterators)
+{
+    SkipListAtomicSingleWriter<std::string, int> sl(10);
+    // transform returns every pair by value
+    auto batch = std::views::iota(0, 300) | std::views::transform(
+                                                [](int i)
+                                                {
+                                                    return std::pair<std::string, int>(
+                                                        "a key too long for small string storage " + std::to_string(1000 + i), i);
+                                                });
+    sl.upsertBatch(batch.begin(), batch.end());
+    EXPECT_EQ(std::distance(sl.begin(), sl.end()), 300);
+    EXPECT_EQ(*sl.find("a key too long for small string storage 1299"), 299);
+}
+
+TEST(SkipListAtomicSingleWriterTest, BulkBuildFromSortedRange)
+{
+    using SL = SkipListAtomicSingleWriter<int, int>;
+    std::vector<std::pair<int, int>> sorted;
+    for (int i = 1; i <= 1024; i++)
+    {
+        sorted.emplace_back(i * 3, i);
+    }
+    SL sl(SL::MAX_HEIGHT, sorted.begin(), sorted.end());
+
+    // the 1024th key is the only one promoted to level 11
+    EXPECT_EQ(sl.getHeight(), 11u);
+    for (int i = 1; i <= 1024; i++)
+    {
+        ASSERT_EQ(*sl.find(i * 3), i);
+        ASSERT_FALSE(sl.find(i * 3 + 1).has_value());
+    }
+    EXPECT_EQ(std::distance(sl.begin(), sl.end()), 1024);
+
+    // the list remains writable
+    sl.upsert(1, -1);
+    sl.upsert(3, -3);
+    EXPECT_EQ(*sl.find(1), -1);
+    EXPECT_EQ(*sl.find(3), -3);
+}
+
+TEST(SkipListAtomicSingleWriterTest, BulkBuildHandlesDuplicatesAndDisorder)
+{
+    using SL = SkipListAtomicSingleWriter<int, int>;
+    std::vector<std::pair<int, int>> input = {{1, 1}, {2, 2}, {2, 20}, {10, 10}, {5, 5}, {11, 11}, {0, 0}, {12, 12}};
+    SL sl(8, input.begin(), input.end());
+
+    std::vector<std::pair<int, int>> expected = {{0, 0}, {1, 1}, {2, 20}, {5, 5}, {10, 10}, {11, 11}, {12, 12}};
+    std::vector<std::pair<int, int>> actual(sl.begin(), sl.end());
+    EXPECT_EQ(actual, expected);
+    for (auto [key, value] : expected)
+    {
+        EXPECT_EQ(*sl.find(key), value);
+    }
+}
+
+TEST(SkipListAtomicSingleWriterTest, BulkBuildFromAnotherList)
+{
+    // keys too long for the small string buffer, so a dangling one is
+    // caught by the sanitizers
+    using SL = SkipListAtomicSingleWriter<std::string, std::string_view>;
+    SL source(10);
+    for (int i = 0; i < 500; i++)
+    {
+        source.upsert("a key too long for small string storage " + std::to_string(1000 + i), "value");
+    }
+
+    // the iterators return their pairs by value
+    SL copy(10, source.begin(), source.end());
+    EXPECT_TRUE(std::equal(copy.begin(), copy.end(), source.begin(), source.end()));
+
+    ArenaOptions options;
+    options.prefault = ArenaOptions::Prefault::Inline;
+    SL prefaulted(10, source.begin(), source.end(), options);
+    EXPECT_EQ(std::distance(prefaulted.begin(), prefaulted.end()), 500);
+    EXPECT_EQ(*prefaulted.find("a key too long for small string storage 1499"), "value");
+}
+
+TEST(SkipListAtomicSingleWriterTest, CursorFindAndSeek)
+{
+    SkipListAtomicSingleWriter<int, int> sl(16);
+    for (int i = 0; i < 5000; i += 2)
+    {
+        sl.upsert(i, i * 2);
+    }
+
+    auto cursor = sl.cursor();
+    auto check = [&](int key)
+    {
+        auto result = cursor.find(key);
+        if (key >= 0 && key < 5000 && key % 2 == 0)
+        {
+            ASSERT_TRUE(result.has_value()) << key;
+            EXPECT_EQ(*result, key * 2);
+        }
+        else
+        {
+            EXPECT_FALSE(result.has_value()) << key;
+        }
+        auto it = cursor.seek(key);
+        int expected = key < 0 ? 0 : key + (key % 2);
+        if (expected >= 5000)
+        {
+            EXPECT_TRUE(it == sl.end()) << key;
+        }
+        else
+        {
+            ASSERT_TRUE(it != sl.end()) << key;
+            EXPECT_EQ(it.key(), expected) << key;
+        }
+    };
+
+    // ascending, descending and jumping around
+    for (int i = -10; i < 5010; i++)
+    {
+        check(i);
+    }
+    for (int i = 5010; i > -10; i--)
+    {
+        check(i);
+    }
+    std::mt19937 g(11);
+    std::uniform_int_distribution<> dis(-100, 5100);
+    for (int i = 0; i < 5000; i++)
+    {
+        check(dis(g));
+    }
+}
+
+TEST(SkipListAtomicSingleWriterTest, CursorSeesLaterInserts)
+{
+    SkipListAtomicSingleWriter<int, int> sl(SkipListAtomicSingleWriter<int, int>::MAX_HEIGHT);
+    auto cursor = sl.cursor();
+    EXPECT_FALSE(cursor.find(1).has_value());
+
+    // the list grows taller than the path the cursor remembered
+    for (int i = 0; i < 10000; i++)
+    {
+        sl.upsert(i, i);
+        if (i % 97 == 0)
+        {
+            ASSERT_EQ(*cursor.find(i), i);
+            ASSERT_EQ(*cursor.find(i / 2), i / 2);
+        }
+    }
+}
+
+TEST(SkipListAtomicSingleWriterTest, FindBatchMatchesFind)
+{
+    SkipListAtomicSingleWriter<int, int> sl(16);
+    std::mt19937 g(5);
+    std::uniform_int_distribution<> dis(0, 20000);
+    for (int i = 0; i < 10000; i++)
+    {
+        int key = dis(g);
+        sl.upsert(key, key + 1);
+    }
+
+    for (size_t batchSize : {0, 1, 15, 16, 17, 64, 1000})
+    {
+        std::vector<int> keys(batchSize);
+        for (auto &key : keys)
+        {
+            key = dis(g);
+        }
+        std::vector<std::optional<int>> out(batchSize, -1);
+        sl.findBatch(keys, out);
+        for (size_t i = 0; i < batchSize; i++)
+        {
+            EXPECT_EQ(out[i], sl.find(keys[i])) << keys[i];
+        }
+    }
+
+    std::vector<int> keys(4);
+    std::vector<std::optional<int>> out(3);
+    EXPECT_THROW(sl.findBatch(keys, out), std::invalid_argument);
+}
+
+TEST(NodeLayoutTest, NodesCarryNoSentinelOverhead)
+{
+    // key, value and one next pointer
+    EXPECT_EQ((SkipListAtomicSingleWriter<int, int>::getNodeSize()), 2 * sizeof(int) + sizeof(void *));
+    EXPECT_EQ((SkipListAtomicMultiWriter<int, int>::getNodeSize()), 2 * sizeof(int) + sizeof(void *));
+    EXPECT_EQ((SkipList<int, int>::getNodeSize()), 2 * sizeof(int) + sizeof(void *));
+    EXPECT_EQ((SkipListMutex<int, int>::getNodeSize()), 2 * sizeof(int) + sizeof(void *));
+}
+
+TEST(SkipListAtomicSingleWriterTest, NonTrivialKeys)
+{
+    SkipListAtomicSingleWriter<std::string, int> sl(8);
+    for (int i = 0; i < 1000; i++)
+    {
+        sl.upsert("key" + std::to_string(i), i);
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        EXPECT_EQ(*sl.find("key" + std::to_string(i)), i);
+    }
+    EXPECT_FALSE(sl.find("").has_value());
+    EXPECT_EQ(sl.begin().key(), "key0");
+}
+
+TEST(SkipListAtomicSingleWriterTest, StringViewKeysAndValuesAreCopied)
+{
+    SkipListAtomicSingleWriter<std::string_view, std::string_view> sl(8);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 500; i++)
+    {
+        // long shared prefixes force full key comparisons
+        keys.push_back("user/0000000" + std::to_string(i * 7919 % 500));
+    }
+    keys.push_back("ab");
+    keys.push_back(std::string("ab\0", 3));
+    keys.push_back("\xff");
+    for (const auto &k : keys)
+    {
+        std::string value = "value of " + k;
+        sl.upsert(k, value);
+    }
+    sl.upsert("ab", "a much longer value than the original one");
+
+    // the list owns its bytes, not the strings passed in
+    for (auto &k : keys)
+    {
+        std::string copy = k;
+        k.assign(k.size(), '#');
+        auto value = sl.find(copy);
+        ASSERT_TRUE(value.has_value());
+        if (copy == "ab")
+        {
+            EXPECT_EQ(*value, "a much longer value than the original one");
+        }
+        else
+        {
+            EXPECT_EQ(*value, "value of " + copy);
+        }
+    }
+    EXPECT_FALSE(sl.find("user/").has_value());
+    EXPECT_FALSE(sl.find(std::string_view("ab\0\0", 4)).has_value());
+
+    std::vector<std::string> seen;
+    for (auto it = sl.begin(); it != sl.end(); ++it)
+    {
+        seen.emplace_back(it.key());
+    }
+    EXPECT_EQ(seen.size(), 503u);
+    EXPECT_TRUE(std::is_sorted(seen.begin(), seen.end()));
+    EXPECT_EQ(seen.front(), "ab");
+    EXPECT_EQ(seen.back(), "\xff");
+    EXPECT_EQ(sl.seek("user/").key(), "user/00000000");
+}
+
+TEST(SkipListAtomicSingleWriterTest, EmptyKeysAndValues)
+{
+    // default constructed views have no data pointer at all
+    SkipListAtomicSingleWriter<std::string_view, std::string_view> sl(8);
+    sl.upsert(std::string_view(), "value");
+    sl.upsert("key", std::string_view());
+    EXPECT_EQ(*sl.find(""), "value");
+    EXPECT_EQ(*sl.find("key"), "");
+    EXPECT_EQ(sl.begin().key(), "");
+
+    sl.upsert(std::string_view(), std::string_view());
+    EXPECT_EQ(*sl.find(std::string_view()), "");
+    EXPECT_EQ(BytewiseComparator::prefix(std::string_view()), 0u);
+}
+
+TEST(SkipListAtomicSingleWriterTest, CustomComparator)
+{
+    SkipListAtomicSingleWriter<int, int, BranchingHalf, std::greater<int>> sl(6);
+    std::vector<std::pair<int, int>> batch;
+    for (int i = 0; i < 200; i++)
+    {
+        sl.upsert(i, i);
+        batch.emplace_back(i, -i);
+    }
+    sl.upsertBatch(batch.begin(), batch.end());
+
+    int expected = 199;
+    for (auto it = sl.begin(); it != sl.end(); ++it, expected--)
+    {
+        EXPECT_EQ(it.key(), expected);
+        EXPECT_EQ(it.value(), -expected);
+    }
+    EXPECT_EQ(expected, -1);
+    EXPECT_EQ(*sl.find(42), -42);
+    EXPECT_EQ(sl.seek(500).key(), 199);
+    EXPECT_EQ(sl.cursor().seek(50).key(), 50);
+}
+
+// a value no std::atomic holds lock-free, each word repeats the version
+struct WideValue
+{
+    uint64_t words[6];
+    uint32_t tail;
+
+    static WideValue of(uint64_t version)
+    {
+        WideValue v;
+        std::fill(std::begin(v.words), std::end(v.words), version);
+        v.tail = static_cast<uint32_t>(version);
+        return v;
+    }
+
+    bool consistent() const
+    {
+        return std::all_of(std::begin(words), std::end(words), [&](uint64_t w) { return w == words[0]; }) &&
+               tail == static_cast<uint32_t>(words[0]);
+    }
+};
+
+TEST(SkipListAtomicSingleWriterTest, WideValuesReadWithoutTearing)
+{
+    static_assert(!std::atomic<WideValue>::is_always_lock_free);
+    SkipListAtomicSingleWriter<int, WideValue> sl(8);
+    for (int k = 0; k < 16; k++)
+    {
+        sl.upsert(k, WideValue::of(0));
+    }
+    EXPECT_EQ(sl.find(3)->words[5], 0u);
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++)
+    {
+        readers.emplace_back([&, t]()
+                             {
+                                 uint64_t last = 0;
+                                 while (!done.load())
+                                 {
+                                     // the writer only ever raises versions
+                                     WideValue v = *sl.find(t);
+                                     ASSERT_TRUE(v.consistent());
+                                     ASSERT_GE(v.words[0], last);
+                                     last = v.words[0];
+                                     for (auto it = sl.begin(); it != sl.end(); ++it)
+                                     {
+                                         ASSERT_TRUE(it.value().consistent());
+                                     }
+                                 } });
+    }
+    for (uint64_t version = 1; version <= 20000; version++)
+    {
+        sl.upsert(static_cast<int>(version % 16), WideValue::of(version));
+    }
+    done = true;
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ(sl.find(0)->words[0], 20000u);
+    EXPECT_EQ(sl.find(15)->tail, 19999u);
+}
+
+TEST(BytewiseComparatorTest, PrefixOrderAgreesWithKeys)
+{
+    std::vector<std::string> keys = {"", "a", std::string("a\0", 2), "ab", "abcdefgh", "abcdefghi", "abcdefgz",
+                                     "b", "\x7f", "\x80", "\xff\xff"};
+    BytewiseComparator compare;
+    for (const auto &a : keys)
+    {
+        for (const auto &b : keys)
+        {
+            if (BytewiseComparator::prefix(a) < BytewiseComparator::prefix(b))
+            {
+                EXPECT_TRUE(compare(a, b)) << a << " " << b;
+            }
+        }
+    }
+    EXPECT_EQ(BytewiseComparator::prefix("\x01\x02"), 0x0102000000000000ull);
+}
+
+TEST(ArenaTest, HotBytesDoNotStraddleCacheLines)
+{
+    Arena arena(4096);
+    for (int i = 0; i < 1000; i++)
+    {
+        size_t hotBytes = 8 + (i % 7) * 8;
+        auto address = reinterpret_cast<uintptr_t>(arena.allocate(hotBytes + 24, 8, hotBytes));
+        EXPECT_EQ(address % 8, 0u);
+        EXPECT_LE(address % Arena::CACHE_LINE_SIZE + hotBytes, Arena::CACHE_LINE_SIZE);
+    }
+}
+
+TEST(ArenaTest, DeallocatedChunksAreReused)
+{
+    Arena arena(4096);
+    void *first = arena.allocate(40, 8);
+    void *second = arena.allocate(40, 8);
+    arena.deallocate(first, 40);
+    arena.deallocate(second, 40);
+    // free lists are last in, first out and sizes are rounded to classes
+    EXPECT_EQ(arena.allocate(37, 8), second);
+    EXPECT_EQ(arena.allocate(40, 8), first);
+    EXPECT_NE(arena.allocate(40, 8), first);
+}
+
+TEST(ArenaTest, BlocksCanBePlacedOnANumaNode)
+{
+    ArenaOptions options;
+    options.blockSize = 4096;
+    options.numaNode = 0;
+    Arena arena(options);
+    for (int i = 0; i < 100; i++)
+    {
+        auto bytes = static_cast<char *>(arena.allocate(1000, 8));
+        std::fill(bytes, bytes + 1000, static_cast<char>(i));
+        EXPECT_EQ(bytes[999], static_cast<char>(i));
+    }
+
+    // blocks are mapped on first use
+    options.numaNode = 1 << 20;
+    Arena unplaceable(options);
+    EXPECT_THROW(unplaceable.allocate(8, 8), std::system_error);
+}
+
+TEST(ArenaTest, HugePageBlocksAreWholeAlignedHugePages)
+{
+    ArenaOptions options;
+    options.blockSize = 4096;
+    options.hugePages = ArenaOptions::HugePages::Transparent;
+    options.prefault = ArenaOptions::Prefault::Inline;
+    Arena arena(options);
+    auto first = reinterpret_cast<uintptr_t>(arena.allocate(64, 8));
+    EXPECT_EQ(first % ArenaOptions::HUGE_PAGE_SIZE, 0u);
+    EXPECT_GE(arena.memoryUsage(), ArenaOptions::HUGE_PAGE_SIZE);
+    // the rounded up block is used in full before the next one
+    for (int i = 0; i < 1000; i++)
+    {
+        arena.allocate(1024, 8);
+    }
+    EXPECT_EQ(arena.blockCount(), 1u);
+
+    // the hugetlb pool is usually empty unless an administrator filled it
+    options.hugePages = ArenaOptions::HugePages::Explicit;
+    try
+    {
+        Arena explicitPages(options);
+        auto bytes = static_cast<char *>(explicitPages.allocate(100, 8));
+        std::fill(bytes, bytes + 100, 'x');
+    }
+    catch (const std::system_error &)
+    {
+    }
+}
+
+TEST(ArenaTest, BackgroundPrefaultHandsOutPreparedBlocks)
+{
+    ArenaOptions options;
+    options.blockSize = 16 * 1024;
+    options.prefault = ArenaOptions::Prefault::Background;
+    SkipListAtomicSingleWriter<int, int> sl(12, options);
+    for (int i = 0; i < 20000; i++)
+    {
+        sl.upsert(i, i);
+    }
+    for (int i = 0; i < 20000; i++)
+    {
+        ASSERT_EQ(sl.find(i), i);
+    }
+    EXPECT_GT(sl.memoryUsage(), (20000 * SkipListAtomicSingleWriter<int, int>::getNodeSize()));
+}
+
+TEST(NumaTopologyTest, ReportsNodesAndCpus)
+{
+    size_t nodes = NumaTopology::nodes();
+    ASSERT_GE(nodes, 1u);
+    EXPECT_LT(static_cast<size_t>(NumaTopology::currentNode()), nodes);
+    EXPECT_FALSE(NumaTopology::cpusOfNode(0).empty());
+    EXPECT_GE(NumaTopology::interleavedCpus().size(), NumaTopology::cpusOfNode(0).size());
+
+    NumaTopology::pinThreadToNode(NumaTopology::currentNode());
+    EXPECT_THROW(NumaTopology::pinThreadToNode(1 << 20), std::invalid_argument);
+}
+
+TEST(EpochManagerTest, GuardDelaysReclamation)
+{
+    EpochManager epochs;
+    int value = 0;
+    size_t freed = 0;
+    auto free = [&](void *memory, size_t bytes)
+    {
+        EXPECT_EQ(memory, &value);
+        EXPECT_EQ(bytes, sizeof(value));
+        freed++;
+    };
+
+    {
+        auto guard = epochs.pin();
+        auto nested = epochs.pin();
+        epochs.retire(&value, sizeof(value));
+        for (int i = 0; i < 5; i++)
+        {
+            EXPECT_EQ(epochs.reclaim(free), 0u);
+        }
+    }
+    EXPECT_EQ(epochs.pending(), 1u);
+    epochs.reclaim(free);
+    epochs.reclaim(free);
+    EXPECT_EQ(freed, 1u);
+    EXPECT_EQ(epochs.pending(), 0u);
+}
+
+TEST(SkipListAtomicSingleWriterTest, EraseRemovesKeys)
+{
+    SkipListAtomicSingleWriter<int, int> sl(12);
+    sl.useReclamation();
+    for (int i = 0; i < 2000; i++)
+    {
+        sl.upsert(i, i);
+    }
+    for (int i = 0; i < 2000; i += 2)
+    {
+        EXPECT_TRUE(sl.erase(i));
+    }
+    EXPECT_FALSE(sl.erase(0));
+    EXPECT_FALSE(sl.erase(5000));
+
+    for (int i = 0; i < 2000; i++)
+    {
+        EXPECT_EQ(sl.find(i).has_value(), i % 2 == 1) << i;
+    }
+    int expected = 1;
+    for (auto it = sl.begin(); it != sl.end(); ++it, expected += 2)
+    {
+        EXPECT_EQ(it.key(), expected);
+    }
+    EXPECT_EQ(expected, 2001);
+
+    sl.upsert(10, -10);
+    EXPECT_EQ(*sl.find(10), -10);
+    EXPECT_EQ(sl.seek(2).key(), 3);
+}
+
+TEST(SkipListAtomicSingleWriterTest, AppendOnlyListsDoNotPinEpochs)
+{
+    SkipListAtomicSingleWriter<int, int> sl(8);
+    for (int i = 0; i < 100; i++)
+    {
+        sl.upsert(i, i);
+    }
+    EXPECT_FALSE(sl.reclaimsMemory());
+    EXPECT_THROW(sl.erase(1), std::logic_error);
+
+    // readers take no epoch slot, so more of them than the slot table
+    // holds may search at the same time
+    constexpr size_t READERS = EpochManager::MAX_THREADS + 8;
+    std::latch searched(READERS);
+    std::atomic<size_t> found{0};
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < READERS; r++)
+    {
+        readers.emplace_back([&, r]()
+                             {
+                                 if (sl.find(static_cast<int>(r % 100)) == static_cast<int>(r % 100))
+                                 {
+                                     found++;
+                                 }
+                                 searched.arrive_and_wait(); });
+    }
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ(found.load(), READERS);
+
+    sl.useReclamation();
+    EXPECT_TRUE(sl.erase(1));
+    EXPECT_FALSE(sl.find(1).has_value());
+}
+
+TEST(SkipListAtomicSingleWriterTest, EraseReusesMemory)
+{
+    SkipListAtomicSingleWriter<std::string_view, std::string_view> sl(12);
+    sl.useReclamation();
+    std::vector<std::string> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.push_back("key" + std::to_string(i));
+        sl.upsert(keys.back(), "value");
+    }
+    size_t usage = sl.memoryUsage();
+
+    for (int round = 0; round < 50; round++)
+    {
+        for (const auto &k : keys)
+        {
+            ASSERT_TRUE(sl.erase(k));
+        }
+        for (const auto &k : keys)
+        {
+            sl.upsert(k, "value");
+            sl.upsert(k, "another value");
+        }
+    }
+    EXPECT_EQ(*sl.find("key7"), "another value");
+    EXPECT_LT(sl.memoryUsage(), 3 * usage);
+}
+
+TEST(SkipListAtomicSingleWriterTest, CursorSurvivesErase)
+{
+    SkipListAtomicSingleWriter<int, int> sl(8);
+    sl.useReclamation();
+    for (int i = 0; i < 100; i += 10)
+    {
+        sl.upsert(i, i);
+    }
+    auto cursor = sl.cursor();
+    EXPECT_EQ(*cursor.find(50), 50);
+
+    // the cursor's path went through 40, which no longer sees 45
+    sl.erase(40);
+    sl.upsert(45, 45);
+    EXPECT_EQ(*cursor.find(45), 45);
+    EXPECT_FALSE(cursor.find(40).has_value());
+    EXPECT_EQ(cursor.seek(41).key(), 45);
+}
+
+TEST(SkipListAtomicSingleWriterTest, ReadersDuringErase)
+{
+    constexpr int KEYS = 1000;
+    SkipListAtomicSingleWriter<int, int> sl(12);
+    sl.useReclamation();
+    for (int i = 0; i < KEYS; i++)
+    {
+        sl.upsert(i, 2 * i);
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++)
+    {
+        readers.emplace_back(
+            [&]()
+            {
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    for (int i = 0; i < KEYS; i += 7)
+                    {
+                        auto value = sl.find(i);
+                        ASSERT_TRUE(!value.has_value() || *value == 2 * i);
+                    }
+                    int previous = -1;
+                    for (auto it = sl.begin(); it != sl.end(); ++it)
+                    {
+                        ASSERT_GT(it.key(), previous);
+                        ASSERT_EQ(it.value(), 2 * it.key());
+                        previous = it.key();
+                    }
+                }
+            });
+    }
+
+    for (int round = 0; round < 20; round++)
+    {
+        for (int i = round % 3; i < KEYS; i += 3)
+        {
+            sl.erase(i);
+        }
+        for (int i = round % 3; i < KEYS; i += 3)
+        {
+            sl.upsert(i, 2 * i);
+        }
+    }
+    done.store(true);
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ(sl.begin().key(), 0);
+}
+
+TEST(VersionedSkipListTest, SnapshotsSeeOlderVersions)
+{
+    VersionedSkipList<int, int> sl(8);
+    sl.upsert(1, 10);
+    sl.upsert(2, 20);
+    uint64_t before = sl.snapshot();
+    sl.upsert(1, 11);
+    sl.erase(2);
+    sl.upsert(3, 30);
+
+    EXPECT_EQ(*sl.find(1, before), 10);
+    EXPECT_EQ(*sl.find(2, before), 20);
+    EXPECT_FALSE(sl.find(3, before).has_value());
+    EXPECT_EQ(*sl.find(1), 11);
+    EXPECT_FALSE(sl.find(2).has_value());
+    EXPECT_EQ(*sl.find(3), 30);
+    EXPECT_FALSE(sl.find(1, 0).has_value());
+
+    std::vector<std::pair<int, int>> old(sl.begin(before), sl.end());
+    EXPECT_EQ(old, (std::vector<std::pair<int, int>>{{1, 10}, {2, 20}}));
+    std::vector<std::pair<int, int>> latest(sl.begin(), sl.end());
+    EXPECT_EQ(latest, (std::vector<std::pair<int, int>>{{1, 11}, {3, 30}}));
+    EXPECT_EQ(sl.seek(2).key(), 3);
+    EXPECT_EQ(sl.seek(2, before).key(), 2);
+    EXPECT_EQ(sl.begin().sequence(), before + 1);
+}
+
+TEST(VersionedSkipListTest, ExplicitSequenceNumbers)
+{
+    VersionedSkipList<std::string_view, std::string_view> sl(8);
+    EXPECT_EQ(sl.upsert("key", "first", 100), 100u);
+    EXPECT_THROW(sl.upsert("key", "stale", 100), std::invalid_argument);
+    EXPECT_EQ(sl.upsert("key", "second"), 101u);
+    EXPECT_EQ(sl.erase("other", 200), 200u);
+    EXPECT_EQ(*sl.find("key", 100), "first");
+    EXPECT_EQ(*sl.find("key"), "second");
+    EXPECT_FALSE(sl.find("key", 99).has_value());
+    EXPECT_FALSE(sl.find("other").has_value());
+}
+
+TEST(VersionedSkipListTest, SnapshotReadsAreConsistent)
+{
+    // the writer moves amounts between accounts, any snapshot must see
+    // the same total
+    constexpr int ACCOUNTS = 64;
+    VersionedSkipList<int, int> sl(10);
+    for (int i = 0; i < ACCOUNTS; i++)
+    {
+        sl.upsert(i, 100);
+    }
+
+    std::atomic<bool> done{false};
+    std::thread reader(
+        [&]()
+        {
+            while (!done.load(std::memory_order_relaxed))
+            {
+                uint64_t snapshot = sl.snapshot();
+                int total = 0;
+                for (auto it = sl.begin(snapshot); it != sl.end(); ++it)
+                {
+                    total += it.value();
+                }
+                ASSERT_EQ(total, ACCOUNTS * 100);
+            }
+        });
+
+    std::mt19937 g(3);
+    std::uniform_int_distribution<> account(0, ACCOUNTS - 1);
+    std::vector<int> balance(ACCOUNTS, 100);
+    for (int i = 0; i < 20000; i++)
+    {
+        int from = account(g);
+        int to = account(g);
+        if (from == to)
+        {
+            continue;
+        }
+        balance[from] -= 1;
+        balance[to] += 1;
+        std::pair<int, int> transfer[] = {{from, balance[from]}, {to, balance[to]}};
+        uint64_t before = sl.snapshot();
+        EXPECT_EQ(sl.upsertBatch(std::begin(transfer), std::end(transfer)), before + 2);
+    }
+    done.store(true);
+    reader.join();
+}
+
+TEST(ShardedSkipListTest, MergedIterationIsOrdered)
+{
+    ShardedSkipList<int, int, 4> sl(10);
+    std::map<int, int> expected;
+    std::mt19937 g(11);
+    std::uniform_int_distribution<> dis(-5000, 5000);
+    for (int i = 0; i < 3000; i++)
+    {
+        int key = dis(g);
+        sl.upsert(key, i);
+        expected[key] = i;
+    }
+
+    std::vector<size_t> perShard(4, 0);
+    for (const auto &[k, v] : expected)
+    {
+        perShard[sl.shardOf(k)]++;
+    }
+    for (size_t count : perShard)
+    {
+        EXPECT_GT(count, expected.size() / 8);
+    }
+
+    std::vector<std::pair<int, int>> merged(sl.begin(), sl.end());
+    EXPECT_EQ(merged, (std::vector<std::pair<int, int>>(expected.begin(), expected.end())));
+
+    auto it = sl.seek(0);
+    EXPECT_EQ(it.key(), expected.lower_bound(0)->first);
+    std::vector<int> scanned;
+    sl.scan(-100, 100, [&](int k, int) { scanned.push_back(k); });
+    std::vector<int> inRange;
+    for (auto e = expected.lower_bound(-100); e != expected.lower_bound(100); ++e)
+    {
+        inRange.push_back(e->first);
+    }
+    EXPECT_EQ(scanned, inRange);
+}
+
+TEST(ShardedSkipListTest, RangePartitioner)
+{
+    using Sharded = ShardedSkipList<int, int, 4, RangePartitioner<int>>;
+    Sharded sl(8, RangePartitioner<int>({100, 200, 300}));
+    EXPECT_EQ(sl.shardOf(-1), 0u);
+    EXPECT_EQ(sl.shardOf(100), 1u);
+    EXPECT_EQ(sl.shardOf(299), 2u);
+    EXPECT_EQ(sl.shardOf(1000), 3u);
+    EXPECT_THROW(RangePartitioner<int>({1, 1}), std::invalid_argument);
+
+    std::vector<std::pair<int, int>> batch;
+    for (int i = 400; i-- > 0;)
+    {
+        batch.emplace_back(i, i);
+    }
+    sl.upsertBatch(batch.begin(), batch.end());
+    EXPECT_EQ(sl.shard(0).begin().key(), 0);
+    EXPECT_EQ(sl.shard(3).begin().key(), 300);
+    int expected = 0;
+    for (auto it = sl.begin(); it != sl.end(); ++it, expected++)
+    {
+        EXPECT_EQ(it.key(), expected);
+    }
+    EXPECT_EQ(expected, 400);
+}
+
+TEST(ShardedSkipListTest, ConcurrentWriters)
+{
+    constexpr int WRITERS = 4;
+    constexpr int KEYS = 20000;
+    ShardedSkipList<int, int, 8> sl(14);
+    std::vector<std::thread> writers;
+    for (int w = 0; w < WRITERS; w++)
+    {
+        writers.emplace_back(
+            [&sl, w]()
+            {
+                for (int i = w; i < KEYS; i += WRITERS)
+                {
+                    sl.upsert(i, -i);
+                }
+            });
+    }
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    for (int i = 0; i < KEYS; i++)
+    {
+        ASSERT_EQ(*sl.find(i), -i);
+    }
+    EXPECT_EQ(std::distance(sl.begin(), sl.end()), KEYS);
+}
+
+TEST(MpscRingBufferTest, FifoAndBounded)
+{
+    MpscRingBuffer<int> queue(3);
+    EXPECT_EQ(queue.capacity(), 4u);
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(queue.tryPush(i));
+    }
+    int value = 42;
+    EXPECT_FALSE(queue.tryPush(value));
+    EXPECT_EQ(queue.pushed(), 4u);
+
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            ASSERT_TRUE(queue.tryPop(value));
+            EXPECT_EQ(value, round * 4 + i);
+        }
+        EXPECT_FALSE(queue.tryPop(value));
+        for (int i = 0; i < 4; i++)
+        {
+            int next = (round + 1) * 4 + i;
+            EXPECT_TRUE(queue.tryPush(next));
+        }
+    }
+}
+
+TEST(WriteQueueTest, ProducersAreAppliedInOrder)
+{
+    constexpr int PRODUCERS = 4;
+    constexpr int KEYS = 5000;
+    SkipListAtomicSingleWriter<int, int> sl(14);
+    {
+        // a small ring makes producers run into a full queue
+        WriteQueue<int, int> queue(sl, 16);
+        std::vector<std::thread> producers;
+        for (int p = 0; p < PRODUCERS; p++)
+        {
+            producers.emplace_back(
+                [&queue, p]()
+                {
+                    for (int i = p; i < KEYS; i += PRODUCERS)
+                    {
+                        queue.upsert(i, 0);
+                        // a later upsert of the same key must win
+                        queue.upsert(i, i);
+                    }
+                    queue.flush();
+                });
+        }
+        for (auto &producer : producers)
+        {
+            producer.join();
+        }
+        for (int i = 0; i < KEYS; i++)
+        {
+            ASSERT_EQ(*sl.find(i), i);
+        }
+
+        auto done = queue.upsertAsync(KEYS, -1);
+        done.get();
+        EXPECT_EQ(*sl.find(KEYS), -1);
+        queue.upsert(KEYS + 1, 1);
+    }
+    // destroying the queue applies what is left
+    EXPECT_EQ(*sl.find(KEYS + 1), 1);
+}
+
+TEST(WriteQueueTest, SynchronousUpsertsDoNotLoseWakeups)
+{
+    SkipListAtomicSingleWriter<int, int> sl(12);
+    WriteQueue<int, int> queue(sl, 4);
+    // the writer sleeps between every upsert, each one has to wake it
+    for (int i = 0; i < 20000; i++)
+    {
+        queue.upsertAsync(i, i).get();
+        ASSERT_EQ(*sl.find(i), i);
+    }
+    queue.flush();
+}
+
+TEST(DistributedSharedMutexTest, WritersExcludeReaders)
+{
+    DistributedSharedMutex<4> mutex;
+    // the two halves are only ever unequal while a writer holds the lock
+    long first = 0;
+    long second = 0;
+    std::atomic<bool> done{false};
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < 3; r++)
+    {
+        threads.emplace_back(
+            [&]()
+            {
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    std::shared_lock<DistributedSharedMutex<4>> lock(mutex);
+                    ASSERT_EQ(first, second);
+                }
+            });
+    }
+    for (int w = 0; w < 2; w++)
+    {
+        threads.emplace_back(
+            [&]()
+            {
+                for (int i = 0; i < 2000; i++)
+                {
+                    std::unique_lock<DistributedSharedMutex<4>> lock(mutex);
+                    first++;
+                    second++;
+                }
+            });
+    }
+    threads[3].join();
+    threads[4].join();
+    done.store(true);
+    for (int r = 0; r < 3; r++)
+    {
+        threads[r].join();
+    }
+    EXPECT_EQ(first, 4000);
+
+    EXPECT_TRUE(mutex.try_lock_shared());
+    EXPECT_FALSE(mutex.try_lock());
+    mutex.unlock_shared();
+    EXPECT_TRUE(mutex.try_lock());
+    EXPECT_FALSE(mutex.try_lock_shared());
+    mutex.unlock();
+}
+
+TEST(SkipListTest, UpdatesAndNonTrivialTypes)
+{
+    SkipList<std::string, std::string> sl(SkipList<std::string, std::string>::MAX_HEIGHT);
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 2000; i++)
+        {
+            sl.upsert("key" + std::to_string(i), "value" + std::to_string(i + round));
+        }
+    }
+    for (int i = 0; i < 2000; i++)
+    {
+        EXPECT_EQ(*sl.find("key" + std::to_string(i)), "value" + std::to_string(i + 2));
+    }
+    EXPECT_FALSE(sl.find("key").has_value());
+    EXPECT_THROW((SkipList<int, int>(0)), std::invalid_argument);
+    EXPECT_THROW((SkipListMutex<int, int>(SkipListMutex<int, int>::MAX_HEIGHT + 1)), std::invalid_argument);
+}
+
+TEST(BasicSkipListTest, PoliciesCompileAwayTheirCosts)
+{
+    using Plain = BasicSkipList<int, int>;
+    using WithMutex = BasicSkipList<int, int, Locked<>>;
+    // only the locked list carries a mutex
+    EXPECT_GE(sizeof(WithMutex), sizeof(Plain) + sizeof(std::shared_mutex));
+    EXPECT_EQ(Plain::getNodeSize(), WithMutex::getNodeSize());
+    EXPECT_EQ((BasicSkipList<int, int, SingleThreaded, Arena, DefaultComparator<int>, 4>::MAX_HEIGHT), 4u);
+    EXPECT_THROW((BasicSkipList<int, int, SingleThreaded, Arena, DefaultComparator<int>, 4>(5)),
+                 std::invalid_argument);
+
+    // the arena arguments follow the height
+    Plain sl(4, 4096);
+    for (int i = 0; i < 1000; i++)
+    {
+        sl.upsert(i, i);
+    }
+    EXPECT_GE(sl.memoryUsage(), 1000 * Plain::getNodeSize());
+    EXPECT_EQ(*sl.find(999), 999);
+}
+
+TEST(SkipListTest, ClearedListsCanBeDestroyed)
+{
+    // the destructor clears again, it must not walk the released nodes
+    {
+        SkipListAtomicSingleWriter<std::string, int> sl(8);
+        sl.upsert("a", 1);
+        sl.clear();
+    }
+    {
+        SkipListAtomicMultiWriter<std::string, int> sl(8);
+        sl.upsert("a", 1);
+        sl.clear();
+    }
+    {
+        SkipList<std::string, std::string> sl(8);
+        sl.upsert("a", "b");
+        sl.clear();
+    }
+}
+
+TEST(SkipListAtomicSingleWriterTest, MemoryStatsFollowWrites)
+{
+    using List = SkipListAtomicSingleWriter<std::string_view, std::string_view>;
+    List sl(12);
+    sl.useReclamation();
+    auto empty = sl.memoryStats();
+    EXPECT_EQ(empty.nodes, 0u);
+    EXPECT_EQ(empty.dataBytes, 0u);
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.push_back("key" + std::to_string(i));
+        sl.upsert(keys.back(), "1234");
+    }
+    auto stats = sl.memoryStats();
+    EXPECT_EQ(stats.nodes, 1000u);
+    size_t towers = 0;
+    for (size_t count : stats.towerHeights)
+    {
+        towers += count;
+    }
+    EXPECT_EQ(towers, 1000u);
+    // about half of the nodes are promoted
+    EXPECT_GT(stats.towerHeights[0], 400u);
+    EXPECT_LT(stats.towerHeights[0], 600u);
+    EXPECT_GE(stats.dataBytes, 1000 * (List::getNodeSize() + 4));
+    EXPECT_LE(stats.dataBytes, stats.reservedBytes);
+
+    sl.upsert("key0", "a longer value");
+    EXPECT_EQ(sl.memoryStats().dataBytes, stats.dataBytes + 10);
+
+    for (const auto &k : keys)
+    {
+        sl.erase(k);
+    }
+    stats = sl.memoryStats();
+    EXPECT_EQ(stats.nodes, 0u);
+    EXPECT_EQ(stats.dataBytes, 0u);
+}
+
+TEST(SkipListAtomicSingleWriterTest, FlushThresholdFiresOnce)
+{
+    SkipListAtomicSingleWriter<int, int> sl(12, 4096);
+    int calls = 0;
+    sl.setFlushThreshold(64 * 1024, [&]() { calls++; });
+    EXPECT_FALSE(sl.flushThresholdReached());
+
+    int inserted = 0;
+    while (!sl.flushThresholdReached())
+    {
+        sl.upsert(inserted, inserted);
+        inserted++;
+    }
+    EXPECT_EQ(calls, 1);
+    EXPECT_GE(sl.memoryUsage(), 64u * 1024);
+    EXPECT_LT(sl.memoryUsage(), 64u * 1024 + 4096 + 64);
+    for (int i = 0; i < 1000; i++)
+    {
+        sl.upsert(inserted + i, i);
+    }
+    EXPECT_EQ(calls, 1);
+
+    // a threshold already exceeded fires right away
+    sl.setFlushThreshold(1024);
+    EXPECT_TRUE(sl.flushThresholdReached());
+}
+
+template <typename T>
+class CountingStatsTest : public SkipListTestFixture<T>
+{
+};
+
+using CountingStatsTypes = ::testing::Types<
+    SkipList<int, int, BranchingHalf, CountingStats>,
+    SkipListAtomicSingleWriter<int, int, BranchingHalf, DefaultComparator<int>, CountingStats>,
+    SkipListMutex<int, int, BranchingHalf, std::shared_mutex, CountingStats>,
+    SkipListAtomicMultiWriter<int, int, BranchingHalf, DefaultComparator<int>, CountingStats>,
+    SkipListFatNode<int, int, 4, BranchingHalf, CountingStats>>;
+
+TYPED_TEST_SUITE(CountingStatsTest, CountingStatsTypes);
+
+TYPED_TEST(CountingStatsTest, CountsOperations)
+{
+    CountingStats::reset();
+    for (int i = 0; i < 500; i++)
+    {
+        this->sl->upsert(i, i);
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        this->sl->upsert(i, -i);
+    }
+    for (int i = 0; i < 300; i++)
+    {
+        this->sl->find(i * 2);
+    }
+
+    SkipListStats stats = CountingStats::collect();
+    EXPECT_EQ(stats.inserts, 500u);
+    EXPECT_EQ(stats.updates, 100u);
+    EXPECT_EQ(stats.finds, 300u);
+    EXPECT_EQ(stats.searches(), 900u);
+    EXPECT_DOUBLE_EQ(stats.updateRatio(), 100.0 / 600);
+
+    uint64_t towers = 0;
+    for (size_t height = 0; height < SkipListStats::MAX_LEVELS; height++)
+    {
+        towers += stats.towerHeights[height];
+        if (height >= TestFixture::TEST_HEIGHT)
+        {
+            EXPECT_EQ(stats.towerHeights[height], 0u);
+            EXPECT_EQ(stats.visits[height], 0u);
+        }
+    }
+    EXPECT_EQ(towers, 500u);
+    // every node passed costs a comparison, and so does every stop
+    uint64_t visits = 0;
+    for (uint64_t levelVisits : stats.visits)
+    {
+        visits += levelVisits;
+    }
+    EXPECT_GT(stats.visits[0], 0u);
+    EXPECT_GT(stats.comparisons, visits);
+
+    CountingStats::reset();
+    EXPECT_EQ(CountingStats::collect().searches(), 0u);
+}
+
+TEST(CountingStatsTest, KeepsCountsOfExitedThreads)
+{
+    CountingStats::reset();
+    SkipListMutex<int, int, BranchingHalf, std::shared_mutex, CountingStats> sl(8);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&sl, t]()
+                             {
+                                 for (int i = 0; i < 250; i++)
+                                 {
+                                     sl.upsert(t * 250 + i, i);
+                                     sl.find(i);
+                                 } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    SkipListStats stats = CountingStats::collect();
+    EXPECT_EQ(stats.inserts, 1000u);
+    EXPECT_EQ(stats.finds, 1000u);
+}
+
+TEST(CountingStatsTest, TimingStatsRecordsLatencies)
+{
+    TimingStats::reset();
+    SkipListAtomicSingleWriter<int, int, BranchingHalf, DefaultComparator<int>, TimingStats> sl(8);
+    for (int i = 0; i < 500; i++)
+    {
+        sl.upsert(i, i);
+        sl.find(i);
+        sl.find(i + 1000);
+    }
+
+    SkipListStats stats = TimingStats::collect();
+    EXPECT_EQ(stats.upsertLatency.count(), 500u);
+    EXPECT_EQ(stats.findLatency.count(), stats.finds);
+    EXPECT_EQ(stats.findLatency.count(), 1000u);
+    EXPECT_GT(stats.findLatency.max(), 0u);
+    EXPECT_LE(stats.findLatency.quantile(0.5), stats.findLatency.quantile(0.99));
+    // the untimed policy keeps its own counters and no latencies
+    EXPECT_EQ(CountingStats::collect().findLatency.count(), 0u);
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact)
+{
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.quantile(0.5), 0u);
+    EXPECT_EQ(histogram.min(), 0u);
+    for (uint64_t value = 1; value <= 100; value++)
+    {
+        histogram.record(value);
+    }
+    EXPECT_EQ(histogram.count(), 100u);
+    EXPECT_EQ(histogram.min(), 1u);
+    EXPECT_EQ(histogram.max(), 100u);
+    EXPECT_DOUBLE_EQ(histogram.mean(), 50.5);
+    EXPECT_EQ(histogram.quantile(0), 1u);
+    EXPECT_EQ(histogram.quantile(0.5), 50u);
+    EXPECT_EQ(histogram.quantile(0.99), 99u);
+    EXPECT_EQ(histogram.quantile(1), 100u);
+}
+
+TEST(LatencyHistogramTest, LargeValuesKeepTheirRelativePrecision)
+{
+    LatencyHistogram histogram;
+    std::mt19937_64 gen(7);
+    std::vector<uint64_t> values;
+    for (int i = 0; i < 100000; i++)
+    {
+        // log-uniform up to about 2^40
+        uint64_t value = gen() >> (24 + gen() % 40);
+        values.push_back(value);
+        histogram.record(value);
+    }
+    histogram.record(UINT64_MAX);
+    values.push_back(UINT64_MAX);
+    std::sort(values.begin(), values.end());
+
+    for (double q : {0.1, 0.5, 0.9, 0.99, 0.999})
+    {
+        uint64_t exact = values[static_cast<size_t>(std::ceil(q * values.size())) - 1];
+        uint64_t reported = histogram.quantile(q);
+        EXPECT_GE(reported, exact);
+        EXPECT_LE(reported - exact, exact / 64 + 1);
+    }
+    EXPECT_EQ(histogram.quantile(1), UINT64_MAX);
+}
+
+TEST(LatencyHistogramTest, MergesAndResets)
+{
+    LatencyHistogram first;
+    LatencyHistogram second;
+    first.record(10, 3);
+    second.record(1000);
+    second.record(5);
+
+    LatencyHistogram merged = first;
+    merged += second;
+    EXPECT_EQ(merged.count(), 5u);
+    EXPECT_EQ(merged.min(), 5u);
+    EXPECT_EQ(merged.max(), 1000u);
+    EXPECT_EQ(merged.quantile(0.8), 10u);
+    EXPECT_EQ(first.count(), 3u);
+
+    merged.reset();
+    EXPECT_EQ(merged.count(), 0u);
+    EXPECT_EQ(merged.max(), 0u);
+    merged = second;
+    EXPECT_EQ(merged.count(), 2u);
+}
+
+// path in the temp directory, removed again with the test
+class TemporaryPath
+{
+public:
+    explicit TemporaryPath(const std::string &name)
+        : path((std::filesystem::temp_directory_path() / (name + "." + std::to_string(::getpid()))).string())
+    {
+    }
+
+    ~TemporaryPath()
+    {
+        std::filesystem::remove(path);
+    }
+
+    const std::string path;
+};
+
+TEST(MappedSkipListTest, FlushedIntegersCanBeFoundAndScanned)
+{
+    TemporaryPath file("skiplist_integers.sst");
+    SkipListAtomicSingleWriter<int, int> sl(12);
+    for (int i = 0; i < 10000; i++)
+    {
+        sl.upsert(i * 2, i);
+    }
+    SortedFileOptions options;
+    options.blockSize = 256;
+    options.bufferSize = 4096;
+    EXPECT_EQ(sl.flush(file.path, options), 10000u);
+    EXPECT_FALSE(std::filesystem::exists(file.path + ".tmp"));
+
+    MappedSkipList<int, int> mapped(file.path);
+    EXPECT_EQ(mapped.records(), 10000u);
+    EXPECT_GT(mapped.blocks(), 100u);
+    for (int i = 0; i < 10000; i++)
+    {
+        ASSERT_EQ(mapped.find(i * 2), i);
+        ASSERT_FALSE(mapped.find(i * 2 + 1).has_value());
+    }
+    EXPECT_FALSE(mapped.find(-1).has_value());
+
+    int expected = 0;
+    for (auto [k, v] : mapped)
+    {
+        ASSERT_EQ(k, expected * 2);
+        ASSERT_EQ(v, expected);
+        expected++;
+    }
+    EXPECT_EQ(expected, 10000);
+
+    EXPECT_EQ(mapped.seek(101).key(), 102);
+    EXPECT_EQ(mapped.seek(20000), mapped.end());
+    std::vector<int> scanned;
+    mapped.scan(10, 20, [&](int k, int) { scanned.push_back(k); });
+    EXPECT_EQ(scanned, (std::vector<int>{10, 12, 14, 16, 18}));
+}
+
+TEST(MappedSkipListTest, StringsAreViewsIntoTheFile)
+{
+    TemporaryPath file("skiplist_strings.sst");
+    SkipListAtomicSingleWriter<std::string_view, std::string_view> sl(12);
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 1000; i++)
+    {
+        expected["key" + std::to_string(i)] = std::string(i % 7 == 0 ? 5000 : i % 50, 'a' + i % 26);
+    }
+    expected[""] = "empty key";
+    for (const auto &[k, v] : expected)
+    {
+        sl.upsert(k, v);
+    }
+    SortedFileOptions options;
+    options.directIO = true;
+    sl.flush(file.path, options);
+
+    MappedSkipList<std::string_view, std::string_view> mapped(file.path);
+    EXPECT_EQ(mapped.records(), expected.size());
+    for (const auto &[k, v] : expected)
+    {
+        auto found = mapped.find(k);
+        ASSERT_TRUE(found.has_value());
+        ASSERT_EQ(*found, v);
+    }
+    EXPECT_FALSE(mapped.find("key").has_value());
+    EXPECT_FALSE(mapped.find("zzz").has_value());
+
+    auto it = mapped.begin();
+    for (const auto &[k, v] : expected)
+    {
+        ASSERT_EQ(it.key(), k);
+        ASSERT_EQ(it.value(), v);
+        ++it;
+    }
+    EXPECT_EQ(it, mapped.end());
+}
+
+TEST(MappedSkipListTest, EmptyListAndBadFiles)
+{
+    TemporaryPath file("skiplist_empty.sst");
+    SkipListAtomicSingleWriter<int, int> sl(4);
+    EXPECT_EQ(sl.flush(file.path), 0u);
+    {
+        MappedSkipList<int, int> mapped(file.path);
+        EXPECT_EQ(mapped.records(), 0u);
+        EXPECT_EQ(mapped.begin(), mapped.end());
+        EXPECT_FALSE(mapped.find(1).has_value());
+    }
+
+    EXPECT_THROW((MappedSkipList<int, int>(file.path + ".missing")), std::system_error);
+    {
+        std::ofstream garbage(file.path, std::ios::trunc);
+        garbage << std::string(100, 'x');
+    }
+    EXPECT_THROW((MappedSkipList<int, int>(file.path)), std::runtime_error);
+
+    {
+        SortedFileWriter<int, int> abandoned(file.path);
+        abandoned.add(1, 1);
+    }
+    EXPECT_FALSE(std::filesystem::exists(file.path + ".tmp"));
+}
+
+TEST(MemtableSetTest, RotatesAndFindsNewestValue)
+{
+    MemtableSet<int, int> memtables(10, 16 * 1024, 4096);
+    int rotations = 0;
+    memtables.setRotationCallback([&]() { rotations++; });
+    for (int i = 0; i < 5000; i++)
+    {
+        memtables.upsert(i, i);
+    }
+    EXPECT_GT(rotations, 2);
+    EXPECT_EQ(memtables.immutables().size(), static_cast<size_t>(rotations));
+    EXPECT_EQ(memtables.view().lists(), static_cast<size_t>(rotations) + 1);
+
+    // the update lands in the active list and shadows the immutable value
+    memtables.upsert(0, -1);
+    for (int i = 0; i < 5000; i++)
+    {
+        ASSERT_EQ(memtables.find(i), i == 0 ? -1 : i);
+    }
+    EXPECT_FALSE(memtables.find(5000).has_value());
+
+    // immutables are handed out oldest first
+    auto immutables = memtables.immutables();
+    EXPECT_TRUE(immutables.front()->find(0).has_value());
+    EXPECT_TRUE(memtables.release(immutables.front().get()));
+    EXPECT_FALSE(memtables.release(immutables.front().get()));
+    EXPECT_EQ(memtables.find(0), -1);
+    EXPECT_FALSE(memtables.find(1).has_value());
+}
+
+TEST(MemtableSetTest, ReleasedListLivesWhileViewed)
+{
+    MemtableSet<int, int> memtables(8, 1 << 20);
+    memtables.upsert(1, 1);
+    memtables.rotate();
+    std::weak_ptr<const MemtableSet<int, int>::List> released = memtables.immutables().front();
+
+    {
+        auto view = memtables.view();
+        EXPECT_TRUE(memtables.release(released.lock().get()));
+        for (int i = 0; i < 4; i++)
+        {
+            memtables.reclaim();
+        }
+        EXPECT_FALSE(released.expired());
+        EXPECT_EQ(view.find(1), 1);
+        EXPECT_FALSE(memtables.find(1).has_value());
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        memtables.reclaim();
+    }
+    EXPECT_TRUE(released.expired());
+}
+
+TEST(MemtableSetTest, ReadersDuringRotationsAndReleases)
+{
+    constexpr int keys = 50000;
+    MemtableSet<int, int> memtables(12, 32 * 1024, 4096);
+    std::atomic<int> written{0};
+    std::atomic<bool> done{false};
+    std::atomic<size_t> found{0};
+    // keys below are in released lists
+    std::atomic<int> releasedBelow{0};
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++)
+    {
+        readers.emplace_back([&, t]()
+                             {
+                                 std::mt19937 gen(t);
+                                 while (!done.load())
+                                 {
+                                     int limit = written.load(std::memory_order_acquire);
+                                     if (limit == 0)
+                                     {
+                                         continue;
+                                     }
+                                     int key = std::uniform_int_distribution<>(0, limit - 1)(gen);
+                                     auto value = memtables.find(key);
+                                     if (value)
+                                     {
+                                         ASSERT_EQ(*value, key);
+                                         found++;
+                                     }
+                                     else
+                                     {
+                                         ASSERT_LT(key, releasedBelow.load(std::memory_order_acquire));
+                                     }
+                                 } });
+    }
+    // plays the flusher, drops all but the newest immutable list
+    std::thread flusher([&]()
+                        {
+                            while (!done.load())
+                            {
+                                auto immutables = memtables.immutables();
+                                for (size_t i = 0; i + 1 < immutables.size(); i++)
+                                {
+                                    int last = 0;
+                                    for (auto [k, v] : *immutables[i])
+                                    {
+                                        last = k;
+                                    }
+                                    releasedBelow.store(last + 1, std::memory_order_release);
+                                    ASSERT_TRUE(memtables.release(immutables[i].get()));
+                                }
+                                memtables.reclaim();
+                                std::this_thread::yield();
+                            } });
+
+    for (int i = 0; i < keys; i++)
+    {
+        memtables.upsert(i, i);
+        written.store(i + 1, std::memory_order_release);
+    }
+    done = true;
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    flusher.join();
+    EXPECT_GT(found.load(), 0u);
+    for (int i = releasedBelow.load(); i < keys; i++)
+    {
+        ASSERT_EQ(memtables.find(i), i);
+    }
+}
+
+TEST(BlockedBloomFilterTest, NoFalseNegativesAndFewFalsePositives)
+{
+    constexpr uint64_t keys = 100000;
+    BlockedBloomFilter filter(keys);
+    for (uint64_t i = 0; i < keys; i++)
+    {
+        filter.add(BlockedBloomFilter::mix(i));
+    }
+    for (uint64_t i = 0; i < keys; i++)
+    {
+        ASSERT_TRUE(filter.mayContain(BlockedBloomFilter::mix(i)));
+    }
+    size_t falsePositives = 0;
+    for (uint64_t i = keys; i < 2 * keys; i++)
+    {
+        falsePositives += filter.mayContain(BlockedBloomFilter::mix(i));
+    }
+    EXPECT_LT(falsePositives, keys / 50);
+    EXPECT_GE(filter.memoryUsage() * 8, keys * 10);
+}
+
+TEST(SkipListAtomicSingleWriterTest, FilterRulesOutMissingKeys)
+{
+    SkipListAtomicSingleWriter<int, int> sl(12);
+    sl.useReclamation();
+    for (int i = 0; i < 1000; i++)
+    {
+        sl.upsert(i * 2, i);
+    }
+    EXPECT_EQ(sl.memoryStats().filterBytes, 0u);
+    sl.useFilter(10000);
+    EXPECT_GT(sl.memoryStats().filterBytes, 0u);
+    EXPECT_THROW(sl.useFilter(10000), std::logic_error);
+    for (int i = 1000; i < 5000; i++)
+    {
+        sl.upsert(i * 2, i);
+    }
+
+    std::vector<int> keys;
+    for (int i = 0; i < 10000; i++)
+    {
+        keys.push_back(i);
+        ASSERT_EQ(sl.find(i), i % 2 == 0 ? std::optional<int>(i / 2) : std::nullopt);
+    }
+    std::vector<std::optional<int>> values(keys.size());
+    sl.findBatch(keys, values);
+    for (int i = 0; i < 10000; i++)
+    {
+        ASSERT_EQ(values[i], i % 2 == 0 ? std::optional<int>(i / 2) : std::nullopt);
+    }
+
+    // erased keys stay in the filter, the search still rules them out
+    sl.erase(0);
+    EXPECT_FALSE(sl.find(0).has_value());
+
+    SkipListAtomicSingleWriter<std::string_view, int> strings(8);
+    strings.useFilter(100);
+    strings.upsert("present", 1);
+    EXPECT_EQ(strings.find("present"), 1);
+    EXPECT_FALSE(strings.find("absent").has_value());
+}
+
+TEST(SkipListFatNodeTest, SplitsKeepOrderAndValues)
+{
+    SkipListFatNode<uint64_t, uint64_t, 8> sl(10);
+    std::map<uint64_t, uint64_t> expected;
+    std::mt19937_64 gen(7);
+    for (int i = 0; i < 20000; i++)
+    {
+        uint64_t k = gen() % 5000;
+        sl.upsert(k, i);
+        expected[k] = i;
+    }
+    for (uint64_t k = 0; k < 5000; k++)
+    {
+        auto it = expected.find(k);
+        ASSERT_EQ(sl.find(k), it == expected.end() ? std::nullopt : std::optional<uint64_t>(it->second));
+    }
+
+    auto it = sl.begin();
+    for (const auto &[k, v] : expected)
+    {
+        ASSERT_NE(it, sl.end());
+        ASSERT_EQ(it.key(), k);
+        ASSERT_EQ(it.value(), v);
+        ++it;
+    }
+    EXPECT_EQ(it, sl.end());
+
+    // blocks are more than half full on average
+    EXPECT_LT(sl.memoryUsage(), expected.size() / 4 * (SkipListFatNode<uint64_t, uint64_t, 8>::getNodeSize() + 64));
+}
+
+TEST(SkipListFatNodeTest, SeekAndScan)
+{
+    SkipListFatNode<int, int> sl(8);
+    for (int i = 100; i > 0; i--)
+    {
+        sl.upsert(i * 10, i);
+    }
+    EXPECT_EQ(sl.seek(-5).key(), 10);
+    EXPECT_EQ(sl.seek(10).key(), 10);
+    EXPECT_EQ(sl.seek(11).key(), 20);
+    EXPECT_EQ(sl.seek(1001), sl.end());
+
+    std::vector<int> keys;
+    sl.scan(95, 145, [&](int k, int) { keys.push_back(k); });
+    EXPECT_EQ(keys, (std::vector<int>{100, 110, 120, 130, 140}));
+}
+
+TEST(SkipListFatNodeTest, ReadersDuringSplits)
+{
+    constexpr int keys = 30000;
+    SkipListFatNode<int, int, 8> sl(14);
+    std::atomic<int> written{0};
+    std::atomic<bool> done{false};
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++)
+    {
+        readers.emplace_back([&, t]()
+                             {
+                                 std::mt19937 gen(t);
+                                 while (!done.load())
+                                 {
+                                     int limit = written.load(std::memory_order_acquire);
+                                     if (limit == 0)
+                                     {
+                                         continue;
+                                     }
+                                     // keys are written in a shuffled order mapped back by value
+                                     int index = std::uniform_int_distribution<>(0, limit - 1)(gen);
+                                     int key = static_cast<int>((index * 7919LL) % keys);
+                                     ASSERT_EQ(sl.find(key), index);
+                                 } });
+    }
+    for (int i = 0; i < keys; i++)
+    {
+        sl.upsert(static_cast<int>((i * 7919LL) % keys), i);
+        written.store(i + 1, std::memory_order_release);
+    }
+    done = true;
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+
+    int count = 0;
+    int previous = -1;
+    for (auto [k, v] : sl)
+    {
+        ASSERT_GT(k, previous);
+        previous = k;
+        count++;
+    }
+    EXPECT_EQ(count, keys);
+}
+
+TEST(ReplicatedSkipListTest, EveryReplicaSeesWrites)
+{
+    ReplicatedSkipList<int, int> sl(10, 2);
+    sl.useReclamation();
+    ASSERT_EQ(sl.replicaCount(), 2u);
+    for (int i = 0; i < 1000; i++)
+    {
+        sl.upsert(i, i * 2);
+    }
+    EXPECT_TRUE(sl.erase(7));
+    EXPECT_FALSE(sl.erase(7));
+
+    for (size_t r = 0; r < sl.replicaCount(); r++)
+    {
+        EXPECT_EQ(sl.replica(r).find(7), std::nullopt);
+        EXPECT_EQ(sl.replica(r).find(500), 1000);
+        EXPECT_EQ(sl.replica(r).memoryStats().nodes, 999u);
+    }
+    EXPECT_EQ(sl.find(999), 1998);
+    EXPECT_GE(sl.memoryUsage(), sl.replica(0).memoryUsage() + sl.replica(1).memoryUsage());
+}
+
+TEST(ReplicatedSkipListTest, ThreadNodeSelectsReplica)
+{
+    ReplicatedSkipList<int, int> sl(10, 2);
+    std::thread([&]()
+                {
+                    EXPECT_EQ(&sl.local(), &sl.replica(static_cast<size_t>(NumaTopology::currentNode()) % 2));
+                    ReplicatedSkipList<int, int>::setThreadNode(1);
+                    EXPECT_EQ(&sl.local(), &sl.replica(1));
+                    ReplicatedSkipList<int, int>::setThreadNode(2);
+                    EXPECT_EQ(&sl.local(), &sl.replica(0)); })
+        .join();
+}